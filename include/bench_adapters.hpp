@@ -0,0 +1,142 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <span>
+
+#include "mpmc_queue.hpp"
+#include "queue_bench.hpp"
+#include "spmc_queue_trivially_copiable.hpp"
+#include "spmc_work_queue.hpp"
+#include "spsc_buffer.hpp"
+#include "spsc_queue.hpp"
+
+// moodycamel orders with standalone fences, which TSAN does not model
+#ifndef __SANITIZE_THREAD__
+#include "moodycammel_queue.hpp"
+#endif
+
+// Adapters that let run_queue_bench drive the queues in this repo and
+// moodycamel::ReaderWriterQueue. Each one owns its queue; endpoints are
+// small handles into it.
+
+// SPSCQueue<...> or another queue with try_push/try_pop on the queue itself
+template<typename Q>
+struct SPSCQueueBench {
+    using value_type = typename Q::value_type;
+    static constexpr bool fan_out = true;
+    static constexpr int max_consumers = 1;
+
+    struct Endpoint {
+        Q* queue;
+        bool try_push(const value_type& value) { return queue->try_push(value); }
+        bool try_pop(value_type& dst) { return queue->try_pop(dst); }
+        std::size_t try_pop_burst(std::span<value_type> dst) { return queue->try_pop_burst(dst); }
+    };
+
+    Endpoint producer() { return {&queue}; }
+    Endpoint make_consumer() { return {&queue}; }
+
+    Q queue;
+};
+
+// SPMCQueue<...>. The producer can't see the consumers, so the ring
+// must hold a whole run or a consumer gets lapped: size it for
+// queue_bench_messages slots.
+template<typename Q>
+struct SPMCQueueBench {
+    using value_type = typename Q::value_type;
+    static constexpr bool fan_out = true;
+    static constexpr int max_consumers = 64;
+
+    struct Producer {
+        Q* queue;
+        bool try_push(const value_type& value) {
+            queue->push(value);
+            return true;
+        }
+    };
+
+    struct Consumer {
+        typename Q::Consumer consumer;
+        bool try_pop(value_type& dst) { return static_cast<bool>(consumer.pop(dst)); }
+        std::size_t try_pop_burst(std::span<value_type> dst) { return consumer.pop_bulk(dst); }
+    };
+
+    Producer producer() { return {&queue}; }
+    Consumer make_consumer() { return {queue.make_consumer()}; }
+
+    Q queue;
+};
+
+// SPMCWorkQueue<...> or MPMCQueue<...>, each message goes to one consumer
+template<typename Q>
+struct SharedQueueBench {
+    using value_type = typename Q::value_type;
+    static constexpr bool fan_out = false;
+    static constexpr int max_consumers = 64;
+
+    struct Endpoint {
+        Q* queue;
+        bool try_push(const value_type& value) { return queue->try_push(value); }
+        bool try_pop(value_type& dst) { return queue->try_pop(dst); }
+        std::size_t try_pop_burst(std::span<value_type> dst) {
+            if constexpr (requires { queue->pop_bulk(dst); }) {
+                return queue->pop_bulk(dst);
+            } else {
+                return queue->try_pop_burst(dst);
+            }
+        }
+    };
+
+    Endpoint producer() { return {&queue}; }
+    Endpoint make_consumer() { return {&queue}; }
+
+    Q queue;
+};
+
+// SPSCBuffer as a stream of whole T records. Every write is one T and
+// publishes it at once, so a read of sizeof(T) bytes always gets a whole T.
+template<typename T>
+struct SPSCBufferBench {
+    using value_type = T;
+    static constexpr bool fan_out = true;
+    static constexpr int max_consumers = 1;
+
+    struct Endpoint {
+        SPSCBuffer* buffer;
+        bool try_push(const T& value) {
+            return buffer->try_write(std::as_bytes(std::span<const T>(&value, 1)));
+        }
+        bool try_pop(T& dst) {
+            return buffer->read(std::as_writable_bytes(std::span<T>(&dst, 1))) != 0;
+        }
+    };
+
+    Endpoint producer() { return {&buffer}; }
+    Endpoint make_consumer() { return {&buffer}; }
+
+    SPSCBuffer buffer{8 * 1024 * 1024};
+};
+
+#ifndef __SANITIZE_THREAD__
+// moodycamel::ReaderWriterQueue with the same 8MB ring as SPSCQueue, fixed
+// size: try_enqueue fails instead of allocating when it is full
+template<typename T>
+struct ReaderWriterQueueBench {
+    using value_type = T;
+    static constexpr bool fan_out = true;
+    static constexpr int max_consumers = 1;
+
+    struct Endpoint {
+        moodycamel::ReaderWriterQueue<T>* queue;
+        bool try_push(const T& value) { return queue->try_enqueue(value); }
+        bool try_pop(T& dst) { return queue->try_dequeue(dst); }
+    };
+
+    Endpoint producer() { return {&queue}; }
+    Endpoint make_consumer() { return {&queue}; }
+
+    moodycamel::ReaderWriterQueue<T> queue{8 * 1024 * 1024 / sizeof(T)};
+};
+#endif
@@ -0,0 +1,78 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <random>
+#include <type_traits>
+#include <vector>
+
+// payloads shared by the benchmarks, so every queue moves the same bytes
+
+enum class Side : char {
+    None = 0,
+    Bid = 'B',
+    Ask = 'S'
+};
+
+// 16 bytes, a best bid/ask update
+struct BestLvlChange {
+    uint64_t qty;
+    uint32_t price;
+    Side side;
+};
+
+inline std::vector<BestLvlChange> make_random_changes(
+    std::size_t n,
+    uint32_t min_price,
+    uint32_t max_price,
+    uint64_t min_qty,
+    uint64_t max_qty,
+    uint64_t seed = 123456789
+) {
+    std::mt19937_64 rng(seed);
+
+    std::uniform_int_distribution<uint32_t> price_dist(min_price, max_price);
+    std::uniform_int_distribution<uint64_t> qty_dist(min_qty, max_qty);
+    std::uniform_int_distribution<int> side_dist(0, 1);
+
+    std::vector<BestLvlChange> values;
+    values.reserve(n);
+
+    for (std::size_t i = 0; i < n; ++i) {
+        BestLvlChange change;
+        change.price = price_dist(rng);
+        change.qty = qty_dist(rng);
+        change.side = side_dist(rng) == 0 ? Side::Bid : Side::Ask;
+        values.push_back(change);
+    }
+
+    return values;
+}
+
+// BestLvlChange padded out to a larger order/execution report size
+template<std::size_t Size>
+struct PaddedChange {
+    BestLvlChange change;
+    std::byte padding[Size - sizeof(BestLvlChange)];
+};
+
+// BestLvlChange with the producer's TSC, for end-to-end latency
+struct StampedChange {
+    uint64_t sent_tsc;
+    BestLvlChange change;
+};
+
+// n random changes as BestLvlChange, PaddedChange or StampedChange
+template<typename Msg>
+std::vector<Msg> make_messages(std::size_t n) {
+    auto changes = make_random_changes(n, 1000, 100'000, 10, 100'000);
+    if constexpr (std::is_same_v<Msg, BestLvlChange>) {
+        return changes;
+    } else {
+        std::vector<Msg> v(n);
+        for (std::size_t i = 0; i < n; ++i) {
+            v[i].change = changes[i];
+        }
+        return v;
+    }
+}
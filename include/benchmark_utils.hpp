@@ -3,15 +3,19 @@
 #include <vector>
 #include <string>
 #include <sys/wait.h>
-#include <unordered_map>
+#include <cmath>
 #include <cstdint>
-#include <cstdint>
-#include <numeric>
+#include <cstdio>
+#include <cstdlib>
 #include <iostream>
 #include <algorithm>
 #include <fstream>
-#include <algorithm>
+#include <stdexcept>
+#include <thread>
+#include <atomic>
+#include <cpuid.h>
 #include <x86intrin.h>
+#include "latency_histogram.hpp"
 
 inline void pin_thread_to_cpu(int cpu) {
     cpu_set_t set;
@@ -55,58 +59,202 @@ inline uint64_t calibrate_tsc() {
     return (tmp + delta_ns / 2) / delta_ns;
 }
 
-inline void export_latency_samples_csv(
-    std::vector<uint64_t>& samples,
+// CPUID.80000007H:EDX[8]: the TSC ticks at a constant rate in every C- and
+// P-state, so it can be used as a clock across cores
+inline bool tsc_is_invariant() {
+    unsigned a, b, c, d;
+    return __get_cpuid(0x80000007, &a, &b, &c, &d) && (d & (1u << 8));
+}
+
+struct TscSkew {
+    // cpu's TSC minus reference_cpu's, in cycles
+    int64_t offset;
+    // round trip of the sample the offset comes from, the offset is only
+    // known to within rtt / 2
+    uint64_t rtt;
+};
+
+// Ping-pong between the two cores: the remote stamp of a round must fall
+// between the local send and receive stamps if the counters agree. The
+// round with the smallest round trip gives the tightest bound.
+inline TscSkew measure_tsc_skew(int reference_cpu, int cpu, int rounds = 10'000) {
+    struct alignas(64) Line {
+        std::atomic<uint64_t> value{0};
+    };
+    Line ping;
+    Line pong;
+    Line remote_tsc;
+
+    std::thread remote([&] {
+        pin_thread_to_cpu(cpu);
+        unsigned aux;
+        for (uint64_t round = 1; round <= static_cast<uint64_t>(rounds); ++round) {
+            while (ping.value.load(std::memory_order_acquire) != round) {
+                _mm_pause();
+            }
+            remote_tsc.value.store(__rdtscp(&aux), std::memory_order_relaxed);
+            pong.value.store(round, std::memory_order_release);
+        }
+    });
+
+    TscSkew best{0, UINT64_MAX};
+    std::thread local([&] {
+        pin_thread_to_cpu(reference_cpu);
+        unsigned aux;
+        for (uint64_t round = 1; round <= static_cast<uint64_t>(rounds); ++round) {
+            uint64_t t0 = __rdtscp(&aux);
+            ping.value.store(round, std::memory_order_release);
+            while (pong.value.load(std::memory_order_acquire) != round) {
+                _mm_pause();
+            }
+            uint64_t t1 = __rdtscp(&aux);
+
+            if (t1 - t0 < best.rtt) {
+                uint64_t remote_stamp = remote_tsc.value.load(std::memory_order_relaxed);
+                best.rtt = t1 - t0;
+                best.offset = static_cast<int64_t>(remote_stamp - (t0 + (t1 - t0) / 2));
+            }
+        }
+    });
+
+    local.join();
+    remote.join();
+    return best;
+}
+
+// Timestamps taken on cpus are compared against ones taken on reference_cpu.
+// Warns when the TSC is not invariant, throws when a core's TSC is provably
+// out of step with the reference one.
+inline void check_tsc_sync(int reference_cpu, const std::vector<int>& cpus) {
+    if (!tsc_is_invariant()) {
+        std::cerr << "warning: the CPU does not report an invariant TSC, cross-core latencies may drift\n";
+    }
+
+    for (int cpu : cpus) {
+        TscSkew skew = measure_tsc_skew(reference_cpu, cpu);
+        std::cout << "tsc cpu " << cpu << " vs cpu " << reference_cpu << ": offset " << skew.offset
+                  << " cycles (+-" << skew.rtt / 2 << ")\n";
+
+        if (static_cast<uint64_t>(std::abs(skew.offset)) > skew.rtt / 2) {
+            throw std::runtime_error(
+                "TSC of cpu " + std::to_string(cpu) + " is " + std::to_string(skew.offset) +
+                " cycles off cpu " + std::to_string(reference_cpu) + ", one-way latencies would be wrong"
+            );
+        }
+    }
+}
+
+// calibrated once per process
+inline uint64_t tsc_frequency() {
+    static const uint64_t freq = calibrate_tsc();
+    return freq;
+}
+
+// Histogram of cycles as latency_ns,count rows (the format
+// analysis/plot_latency_distribution.py reads) plus a summary on stdout.
+// Each bucket is reported at its midpoint.
+inline void export_latency_histogram_csv(
+    const LatencyHistogram& histogram,
     const std::string& file_name,
     const std::string& thread_name
 ) {
-    if (samples.empty()) {
+    if (histogram.count() == 0) {
         return;
     }
 
-    static uint64_t tsc_freq = calibrate_tsc();
+    const uint64_t tsc_freq = tsc_frequency();
 
-    std::sort(samples.begin(), samples.end());
+    std::ofstream out(file_name);
+    if (!out) {
+        std::abort();
+    }
 
-    auto percentile = [&](double p) {
-        size_t idx = static_cast<size_t>(p * (samples.size() - 1));
-        return samples[idx];
-    };
+    // neighbouring buckets can round to the same ns, merge them
+    out << "latency_ns,count\n";
+    uint64_t row_ns = 0;
+    uint64_t row_count = 0;
+    histogram.for_each_bucket([&](uint64_t lowest, uint64_t highest, uint64_t count) {
+        uint64_t ns = cycles_to_ns(lowest + (highest - lowest) / 2, tsc_freq);
+        if (row_count != 0 && ns != row_ns) {
+            out << row_ns << "," << row_count << '\n';
+            row_count = 0;
+        }
+        row_ns = ns;
+        row_count += count;
+    });
+    out << row_ns << "," << row_count << '\n';
 
-    uint64_t p50  = percentile(0.50);
-    uint64_t p95  = percentile(0.95);
-    uint64_t p99  = percentile(0.99);
-    uint64_t p999 = percentile(0.999);
+    double elapsed_sec = static_cast<double>(histogram.total_value()) / static_cast<double>(tsc_freq);
+    double throughput = histogram.count() / elapsed_sec;
 
-    std::unordered_map<uint64_t, uint64_t> histogram;
-    histogram.reserve(samples.size() / 4);
+    std::cout << thread_name << '\n';
+    std::cout << "p50  (ns): " << cycles_to_ns(histogram.percentile(0.50),  tsc_freq) << '\n';
+    std::cout << "p95  (ns): " << cycles_to_ns(histogram.percentile(0.95),  tsc_freq) << '\n';
+    std::cout << "p99  (ns): " << cycles_to_ns(histogram.percentile(0.99),  tsc_freq) << '\n';
+    std::cout << "p999 (ns): " << cycles_to_ns(histogram.percentile(0.999), tsc_freq) << '\n';
+    std::cout << "max  (ns): " << cycles_to_ns(histogram.max(), tsc_freq) << '\n';
+    std::cout << "throughput (ops/s): " << throughput << '\n';
+}
 
-    for (uint64_t cycles : samples) {
-        uint64_t ns = cycles_to_ns(cycles, tsc_freq);
-        ++histogram[ns];
+// HdrHistogram percentile distribution (.hgrm) in ns, one row per
+// non-empty bucket, readable by the usual HdrHistogram plotters
+inline void export_latency_histogram_hgrm(const LatencyHistogram& histogram, const std::string& file_name) {
+    if (histogram.count() == 0) {
+        return;
     }
 
-    // Export
+    const double ns_per_cycle = 1e9 / static_cast<double>(tsc_frequency());
+
     std::ofstream out(file_name);
     if (!out) {
         std::abort();
     }
 
-    out << "latency_ns,count\n";
-    for (const auto& [latency, count] : histogram) {
-        out << latency << "," << count << '\n';
-    }
+    char line[128];
+    out << "       Value     Percentile TotalCount 1/(1-Percentile)\n\n";
 
-    double elapsed_sec = static_cast<double>(std::accumulate(samples.begin(), samples.end(), 0)) /
-                         static_cast<double>(tsc_freq);
+    const double total = static_cast<double>(histogram.count());
+    const double mean = histogram.mean();
+    double squares = 0.0;
+    uint64_t seen = 0;
+    histogram.for_each_bucket([&](uint64_t lowest, uint64_t highest, uint64_t count) {
+        double mid = static_cast<double>(lowest + (highest - lowest) / 2);
+        squares += (mid - mean) * (mid - mean) * static_cast<double>(count);
 
-    double throughput = samples.size() / elapsed_sec;
+        seen += count;
+        double value = static_cast<double>(std::min(highest, histogram.max())) * ns_per_cycle;
+        double percentile = static_cast<double>(seen) / total;
+        if (seen < histogram.count()) {
+            std::snprintf(line, sizeof(line), "%12.3f %2.12f %10lu %14.2f\n",
+                          value, percentile, static_cast<unsigned long>(seen), 1.0 / (1.0 - percentile));
+        } else {
+            std::snprintf(line, sizeof(line), "%12.3f %2.12f %10lu\n",
+                          value, percentile, static_cast<unsigned long>(seen));
+        }
+        out << line;
+    });
 
-    std::cout << thread_name << '\n';
-    std::cout << "p50  (ns): " << cycles_to_ns(p50,  tsc_freq) << '\n';
-    std::cout << "p95  (ns): " << cycles_to_ns(p95,  tsc_freq) << '\n';
-    std::cout << "p99  (ns): " << cycles_to_ns(p99,  tsc_freq) << '\n';
-    std::cout << "p999 (ns): " << cycles_to_ns(p999, tsc_freq) << '\n';
-    std::cout << "throughput (ops/s): " << throughput << '\n';
+    std::snprintf(line, sizeof(line), "#[Mean    = %12.3f, StdDeviation   = %12.3f]\n",
+                  mean * ns_per_cycle, std::sqrt(squares / total) * ns_per_cycle);
+    out << line;
+    std::snprintf(line, sizeof(line), "#[Max     = %12.3f, Total count    = %12lu]\n",
+                  static_cast<double>(histogram.max()) * ns_per_cycle, static_cast<unsigned long>(histogram.count()));
+    out << line;
+    std::snprintf(line, sizeof(line), "#[Buckets = %12lu, SubBuckets     = %12lu]\n",
+                  static_cast<unsigned long>(LatencyHistogram::bucket_count),
+                  static_cast<unsigned long>(LatencyHistogram::sub_bucket_count));
+    out << line;
 }
 
+// raw samples in cycles, goes through a LatencyHistogram
+inline void export_latency_samples_csv(
+    const std::vector<uint64_t>& samples,
+    const std::string& file_name,
+    const std::string& thread_name
+) {
+    LatencyHistogram histogram;
+    for (uint64_t cycles : samples) {
+        histogram.record(cycles);
+    }
+    export_latency_histogram_csv(histogram, file_name, thread_name);
+}
@@ -0,0 +1,22 @@
+#pragma once
+#include <span>
+#include <cstddef>
+
+// Zero-copy views into a byte ring. A range that wraps around the end of
+// the ring is split in two, `second` is empty otherwise.
+
+struct ReadView {
+    std::span<const std::byte> first;
+    std::span<const std::byte> second;
+
+    size_t size() const { return first.size() + second.size(); }
+    bool empty() const { return first.empty(); }
+};
+
+struct WriteView {
+    std::span<std::byte> first;
+    std::span<std::byte> second;
+
+    size_t size() const { return first.size() + second.size(); }
+    bool empty() const { return first.empty(); }
+};
@@ -0,0 +1,3 @@
+#pragma once
+
+void run_ipc_bench(int consumer_count);
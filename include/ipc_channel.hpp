@@ -0,0 +1,205 @@
+#pragma once
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <new>
+#include <optional>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <type_traits>
+#include <utility>
+#include "mirrored_mapping.hpp"
+#include "shared_segment.hpp"
+
+// Places one Object (e.g. an IPCSPSCBuffer) in a named shared memory segment.
+// The creator constructs it exactly once, any number of processes attach.
+// A header in front of the object records what was placed there, attaching
+// with a different Object type, size or channel version throws instead of
+// silently reinterpreting the memory.
+//
+// The segment, and the object in it, outlive every IPCChannel until
+// IPCChannel::unlink(name). The object's destructor never runs.
+
+namespace ipc_detail {
+
+// both sides are expected to be built by the same toolchain
+template<typename T>
+constexpr uint64_t type_id() {
+    std::string_view signature = __PRETTY_FUNCTION__;
+    uint64_t hash = 14695981039346656037ull;
+    for (char c : signature) {
+        hash = (hash ^ static_cast<uint8_t>(c)) * 1099511628211ull;
+    }
+    return hash;
+}
+
+enum class ChannelState : uint32_t {
+    Empty = 0,
+    Constructing = 1,
+    Ready = 2,
+};
+
+struct ChannelHeader {
+    static constexpr uint64_t magic_ = 0x4c454e4e41484350; // "PCHANNEL"
+    static constexpr uint32_t version_ = 1;
+
+    // a fresh segment is zero filled, i.e. Empty
+    std::atomic<ChannelState> state;
+    uint32_t version;
+    uint64_t magic;
+    uint64_t typeId;
+    uint64_t objectSize;
+    uint64_t objectOffset;
+};
+
+}  // namespace ipc_detail
+
+template<typename Object>
+class IPCChannel {
+    static_assert(std::is_trivially_destructible_v<Object>,
+        "the object stays in shared memory after every process detached, its destructor would never run");
+
+public:
+    static constexpr auto defaultAttachTimeout_ = std::chrono::seconds(5);
+
+    // Creates the segment and constructs Object(args...) in it.
+    // Throws std::runtime_error if the name already exists. If the
+    // constructor throws, the segment is unlinked again.
+    template<typename... Args>
+    static IPCChannel create(const std::string& name, ShmBacking backing, Args&&... args) {
+        reject_mirrored(args...);
+        auto segment = SharedSegment::create(name, objectOffset_ + sizeof(Object), backing);
+        if (!segment) {
+            throw std::runtime_error("IPC channel " + name + " already exists");
+        }
+        return IPCChannel{Construct{}, name, std::move(*segment), std::forward<Args>(args)...};
+    }
+
+    // Waits up to timeout for the creator to finish, then validates the header.
+    static IPCChannel attach(const std::string& name,
+                             std::chrono::milliseconds timeout = defaultAttachTimeout_) {
+        const auto deadline = std::chrono::steady_clock::now() + timeout;
+
+        std::optional<SharedSegment> segment;
+        while (!(segment = SharedSegment::open_existing(name))) {
+            wait_or_throw(deadline, "IPC channel " + name + " does not exist");
+        }
+
+        if (segment->size() < sizeof(ipc_detail::ChannelHeader)) {
+            throw std::runtime_error("IPC channel " + name + " is too small to be a channel");
+        }
+
+        auto* header = reinterpret_cast<ipc_detail::ChannelHeader*>(segment->data());
+        while (header->state.load(std::memory_order_acquire) != ipc_detail::ChannelState::Ready) {
+            wait_or_throw(deadline, "IPC channel " + name + " was not initialized by its creator");
+        }
+
+        validate(*header, segment->size(), name);
+        return IPCChannel{std::move(*segment)};
+    }
+
+    // Creates the channel, or attaches if another process got there first.
+    template<typename... Args>
+    static IPCChannel open(const std::string& name, ShmBacking backing, Args&&... args) {
+        reject_mirrored(args...);
+        if (auto segment = SharedSegment::create(name, objectOffset_ + sizeof(Object), backing)) {
+            return IPCChannel{Construct{}, name, std::move(*segment), std::forward<Args>(args)...};
+        }
+        return attach(name);
+    }
+
+    static void unlink(const std::string& name) {
+        SharedSegment::unlink(name);
+    }
+
+    IPCChannel(IPCChannel&&) noexcept = default;
+    IPCChannel& operator=(IPCChannel&&) noexcept = default;
+
+    Object& operator*() const { return *object_; }
+    Object* operator->() const { return object_; }
+    bool huge_pages() const { return segment_.huge_pages(); }
+
+private:
+    // the object starts on its own page, so page-aligned members stay page aligned in the file
+    static constexpr size_t objectAlign_ = std::max<size_t>(alignof(Object), 4096);
+    static constexpr size_t objectOffset_ =
+        (sizeof(ipc_detail::ChannelHeader) + objectAlign_ - 1) / objectAlign_ * objectAlign_;
+
+    struct Construct {};
+
+    template<typename... Args>
+    IPCChannel(Construct, const std::string& name, SharedSegment segment, Args&&... args)
+    : segment_{std::move(segment)}
+    {
+        auto* header = new (segment_.data()) ipc_detail::ChannelHeader{};
+        header->state.store(ipc_detail::ChannelState::Constructing, std::memory_order_relaxed);
+        header->version = ipc_detail::ChannelHeader::version_;
+        header->magic = ipc_detail::ChannelHeader::magic_;
+        header->typeId = ipc_detail::type_id<Object>();
+        header->objectSize = sizeof(Object);
+        header->objectOffset = objectOffset_;
+
+        try {
+            object_ = new (segment_.data() + objectOffset_) Object(std::forward<Args>(args)...);
+        } catch (...) {
+            // don't leave a channel behind that attach waits on and create trips over
+            header->magic = 0;
+            header->state.store(ipc_detail::ChannelState::Empty, std::memory_order_release);
+            SharedSegment::unlink(name);
+            throw;
+        }
+        header->state.store(ipc_detail::ChannelState::Ready, std::memory_order_release);
+    }
+
+    explicit IPCChannel(SharedSegment segment)
+    : segment_{std::move(segment)},
+      object_{std::launder(reinterpret_cast<Object*>(segment_.data() + objectOffset_))}
+    {}
+
+    // The segment is mapped once, a ring constructed as mirrored would be
+    // read and written past its end. Mirrored rings have to be mapped by hand.
+    template<typename... Args>
+    static void reject_mirrored(const Args&... args) {
+        if ((is_mirrored(args) || ...)) {
+            throw std::invalid_argument("IPC channels map the ring once, RingMapping::Mirrored is not supported");
+        }
+    }
+
+    template<typename Arg>
+    static bool is_mirrored(const Arg& arg) {
+        if constexpr (std::is_same_v<Arg, RingMapping>) {
+            return arg == RingMapping::Mirrored;
+        } else {
+            return false;
+        }
+    }
+
+    static void validate(const ipc_detail::ChannelHeader& header, size_t segmentSize, const std::string& name) {
+        if (header.magic != ipc_detail::ChannelHeader::magic_) {
+            throw std::runtime_error("IPC channel " + name + " has no channel header");
+        }
+        if (header.version != ipc_detail::ChannelHeader::version_) {
+            throw std::runtime_error("IPC channel " + name + " was created by a different channel version");
+        }
+        if (header.typeId != ipc_detail::type_id<Object>() ||
+            header.objectSize != sizeof(Object) ||
+            header.objectOffset != objectOffset_ ||
+            segmentSize < objectOffset_ + sizeof(Object)) {
+            throw std::runtime_error("IPC channel " + name + " holds a different object type or layout");
+        }
+    }
+
+    static void wait_or_throw(std::chrono::steady_clock::time_point deadline, const std::string& what) {
+        if (std::chrono::steady_clock::now() >= deadline) {
+            throw std::runtime_error(what);
+        }
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+
+    SharedSegment segment_;
+    Object* object_ = nullptr;
+};
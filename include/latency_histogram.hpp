@@ -0,0 +1,127 @@
+#pragma once
+
+#include <algorithm>
+#include <bit>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+#include <stdexcept>
+#include <vector>
+
+// Fixed-size log-linear (HDR-style) histogram of latencies in cycles.
+//
+// Values below 2^sub_bucket_bits get a bucket each and are exact. Above
+// that, every power of two is split into 2^(sub_bucket_bits - 1) equal
+// buckets, so a value is known to within 1/128 of itself. The whole
+// uint64_t range fits in ~59KB, record() is a bit scan, a shift and an
+// increment, and histograms recorded on different threads can be merged.
+// Cache line aligned so per-thread histograms in an array don't false share.
+class alignas(64) LatencyHistogram {
+public:
+    static constexpr unsigned sub_bucket_bits = 8;
+    static constexpr uint64_t sub_bucket_count = uint64_t{1} << sub_bucket_bits;
+    static constexpr uint64_t half_count = sub_bucket_count / 2;
+    static constexpr std::size_t bucket_count = sub_bucket_count + (64 - sub_bucket_bits) * half_count;
+
+    LatencyHistogram()
+    : counts(bucket_count, 0)
+    {}
+
+    void record(uint64_t value) {
+        ++counts[index_of(value)];
+        ++total;
+        sum += value;
+        min_value = std::min(min_value, value);
+        max_value = std::max(max_value, value);
+    }
+
+    void merge(const LatencyHistogram& other) {
+        for (std::size_t i = 0; i < bucket_count; ++i) {
+            counts[i] += other.counts[i];
+        }
+        total += other.total;
+        sum += other.sum;
+        min_value = std::min(min_value, other.min_value);
+        max_value = std::max(max_value, other.max_value);
+    }
+
+    void reset() {
+        std::fill(counts.begin(), counts.end(), 0);
+        total = 0;
+        sum = 0;
+        min_value = std::numeric_limits<uint64_t>::max();
+        max_value = 0;
+    }
+
+    uint64_t count() const { return total; }
+    uint64_t min() const { return total ? min_value : 0; }
+    uint64_t max() const { return max_value; }
+    // sum of all recorded values, wraps after 2^64 cycles (~140 years at 4GHz)
+    uint64_t total_value() const { return sum; }
+    double mean() const { return total ? static_cast<double>(sum) / static_cast<double>(total) : 0.0; }
+
+    // The smallest v with at least p (in [0, 1]) of the samples <= v. Exact
+    // below 2^sub_bucket_bits, otherwise the top of v's bucket capped at max().
+    uint64_t percentile(double p) const {
+        if (p < 0.0 || p > 1.0) {
+            throw std::invalid_argument("percentile must be in [0, 1]");
+        }
+        if (total == 0) {
+            return 0;
+        }
+
+        const uint64_t rank = std::max<uint64_t>(1, static_cast<uint64_t>(std::ceil(p * static_cast<double>(total))));
+        uint64_t seen = 0;
+        for (std::size_t i = 0; i < bucket_count; ++i) {
+            seen += counts[i];
+            if (seen >= rank) {
+                return std::clamp(highest_in_bucket(i), min(), max());
+            }
+        }
+        return max_value;
+    }
+
+    // calls f(lowest, highest, count) for every non-empty bucket in order
+    template<typename F>
+    void for_each_bucket(F&& f) const {
+        for (std::size_t i = 0; i < bucket_count; ++i) {
+            if (counts[i] != 0) {
+                f(lowest_in_bucket(i), highest_in_bucket(i), counts[i]);
+            }
+        }
+    }
+
+    static std::size_t index_of(uint64_t value) {
+        if (value < sub_bucket_count) {
+            return value;
+        }
+        // value >> shift keeps the top sub_bucket_bits bits, in [half_count, sub_bucket_count)
+        const unsigned shift = std::bit_width(value) - sub_bucket_bits;
+        return (static_cast<std::size_t>(shift) << (sub_bucket_bits - 1)) + (value >> shift);
+    }
+
+    static uint64_t lowest_in_bucket(std::size_t index) {
+        if (index < sub_bucket_count) {
+            return index;
+        }
+        const unsigned shift = static_cast<unsigned>(index >> (sub_bucket_bits - 1)) - 1;
+        const uint64_t sub_bucket = index - (static_cast<uint64_t>(shift) << (sub_bucket_bits - 1));
+        return sub_bucket << shift;
+    }
+
+    static uint64_t highest_in_bucket(std::size_t index) {
+        if (index < sub_bucket_count) {
+            return index;
+        }
+        const unsigned shift = static_cast<unsigned>(index >> (sub_bucket_bits - 1)) - 1;
+        return lowest_in_bucket(index) + ((uint64_t{1} << shift) - 1);
+    }
+
+private:
+    std::vector<uint64_t> counts;
+    uint64_t total{0};
+    uint64_t sum{0};
+    uint64_t min_value{std::numeric_limits<uint64_t>::max()};
+    uint64_t max_value{0};
+};
@@ -0,0 +1,150 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <fstream>
+#include <random>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+// Arrival processes for open-loop benchmarks
+enum class Arrivals {
+    // one message every 1/rate seconds
+    Constant,
+    // exponential inter-arrival times with mean 1/rate
+    Poisson,
+    // inter-arrival times of a captured feed, scaled to the rate
+    Replay,
+};
+
+// Intended send times of an open-loop run, in TSC cycles from its start.
+// The producer sends message i at start + offset(i) however late the
+// previous ones were, and latency is measured from that time, so a stalled
+// producer or a full queue shows up in the numbers instead of silently
+// lowering the rate (coordinated omission).
+class SendSchedule {
+public:
+    static SendSchedule constant(double rate, std::size_t count, uint64_t tsc_freq) {
+        const double gap = cycles_per_message(rate, tsc_freq);
+        SendSchedule schedule;
+        schedule.offsets.resize(count);
+        for (std::size_t i = 0; i < count; ++i) {
+            schedule.offsets[i] = static_cast<uint64_t>(gap * static_cast<double>(i));
+        }
+        return schedule;
+    }
+
+    static SendSchedule poisson(double rate, std::size_t count, uint64_t tsc_freq, uint64_t seed = 123456789) {
+        std::mt19937_64 rng(seed);
+        std::exponential_distribution<double> gap(1.0 / cycles_per_message(rate, tsc_freq));
+
+        SendSchedule schedule;
+        schedule.offsets.resize(count);
+        // accumulate in double so rounding doesn't drift the rate
+        double t = 0.0;
+        for (std::size_t i = 0; i < count; ++i) {
+            schedule.offsets[i] = static_cast<uint64_t>(t);
+            t += gap(rng);
+        }
+        return schedule;
+    }
+
+    // Receive timestamps in ns, one per line (e.g. exported from a pcap),
+    // lines that don't start with a digit are skipped. The gaps are replayed
+    // in order, wrapping around when count exceeds the capture, and scaled so
+    // the mean rate is rate; rate 0 keeps the capture's own timing.
+    static SendSchedule replay(const std::string& file_name, double rate, std::size_t count, uint64_t tsc_freq) {
+        std::vector<uint64_t> gaps_ns = load_capture_gaps(file_name);
+
+        double mean_gap_ns = 0.0;
+        for (uint64_t gap : gaps_ns) {
+            mean_gap_ns += static_cast<double>(gap);
+        }
+        mean_gap_ns /= static_cast<double>(gaps_ns.size());
+
+        double scale = static_cast<double>(tsc_freq) / 1e9;
+        if (rate > 0.0) {
+            if (mean_gap_ns == 0.0) {
+                throw std::invalid_argument(file_name + ": every message has the same timestamp, can't scale it to a rate");
+            }
+            scale = cycles_per_message(rate, tsc_freq) / mean_gap_ns;
+        }
+
+        SendSchedule schedule;
+        schedule.offsets.resize(count);
+        double t = 0.0;
+        for (std::size_t i = 0; i < count; ++i) {
+            schedule.offsets[i] = static_cast<uint64_t>(t);
+            t += static_cast<double>(gaps_ns[i % gaps_ns.size()]) * scale;
+        }
+        return schedule;
+    }
+
+    static SendSchedule make(Arrivals arrivals, double rate, std::size_t count, uint64_t tsc_freq,
+                             const std::string& capture = {}) {
+        switch (arrivals) {
+            case Arrivals::Constant:
+                return constant(rate, count, tsc_freq);
+            case Arrivals::Poisson:
+                return poisson(rate, count, tsc_freq);
+            case Arrivals::Replay:
+                return replay(capture, rate, count, tsc_freq);
+        }
+        throw std::invalid_argument("unknown arrival process");
+    }
+
+    uint64_t operator[](std::size_t i) const { return offsets[i]; }
+    std::size_t size() const { return offsets.size(); }
+
+private:
+    static double cycles_per_message(double rate, uint64_t tsc_freq) {
+        if (!(rate > 0.0)) {
+            throw std::invalid_argument("rate must be positive");
+        }
+        return static_cast<double>(tsc_freq) / rate;
+    }
+
+    static std::vector<uint64_t> load_capture_gaps(const std::string& file_name) {
+        std::ifstream in(file_name);
+        if (!in) {
+            throw std::runtime_error("can't open capture " + file_name);
+        }
+
+        std::vector<uint64_t> timestamps;
+        std::string line;
+        while (std::getline(in, line)) {
+            if (!line.empty() && line[0] >= '0' && line[0] <= '9') {
+                timestamps.push_back(std::stoull(line));
+            }
+        }
+        if (timestamps.size() < 2) {
+            throw std::invalid_argument(file_name + ": a capture needs at least two timestamps");
+        }
+
+        std::vector<uint64_t> gaps(timestamps.size() - 1);
+        for (std::size_t i = 1; i < timestamps.size(); ++i) {
+            if (timestamps[i] < timestamps[i - 1]) {
+                throw std::invalid_argument(file_name + ": timestamps must not go backwards");
+            }
+            gaps[i - 1] = timestamps[i] - timestamps[i - 1];
+        }
+        return gaps;
+    }
+
+    std::vector<uint64_t> offsets;
+};
+
+// "constant", "poisson" or "replay", as given on the command line
+inline Arrivals parse_arrivals(const std::string& name) {
+    if (name == "constant") {
+        return Arrivals::Constant;
+    }
+    if (name == "poisson") {
+        return Arrivals::Poisson;
+    }
+    if (name == "replay") {
+        return Arrivals::Replay;
+    }
+    throw std::invalid_argument("unknown arrival process " + name + ", expected constant, poisson or replay");
+}
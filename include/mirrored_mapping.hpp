@@ -0,0 +1,44 @@
+#pragma once
+#include <cstddef>
+
+// How a byte ring is mapped. With Mirrored the ring pages are mapped a second
+// time right behind the first copy, so any access of up to the ring size
+// starting inside the ring is contiguous and never has to be split at the end.
+enum class RingMapping {
+    Single,
+    Mirrored,
+};
+
+// Maps a memfd or shared memory file so that the ring [offset, offset + size)
+// of the file appears twice back to back:
+//
+//   data()                       data() + offset + size
+//   | file [0, offset + size)    | file [offset, offset + size) again |
+//
+// offset and size must be multiples of the page size.
+class MirroredMapping {
+public:
+    // a private memfd that is only the ring, size is rounded up to whole pages
+    explicit MirroredMapping(size_t size);
+    // maps an existing file, e.g. a shm_open() descriptor, the caller keeps fd
+    MirroredMapping(int fd, size_t offset, size_t size);
+    ~MirroredMapping();
+
+    MirroredMapping(const MirroredMapping&) = delete;
+    MirroredMapping(MirroredMapping&&) = delete;
+
+    MirroredMapping& operator=(const MirroredMapping&) = delete;
+    MirroredMapping& operator=(MirroredMapping&&) = delete;
+
+    std::byte* data() const { return base_; }
+    // total mapped length, offset + 2 * size
+    size_t length() const { return length_; }
+
+    static size_t page_size();
+
+private:
+    void map(int fd, size_t offset, size_t size);
+
+    std::byte* base_ = nullptr;
+    size_t length_ = 0;
+};
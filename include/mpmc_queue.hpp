@@ -0,0 +1,184 @@
+#pragma once
+
+#include <atomic>
+#include <bit>
+#include <cstdint>
+#include <span>
+#include <type_traits>
+#include "queue_concepts.hpp"
+#include "queue_storage.hpp"
+#include "wait_policy.hpp"
+
+// where the shared positions live
+enum class IndexLayout {
+    // head and tail share one cache line, so producers and consumers
+    // invalidate each other's line on every claim
+    Shared,
+    // head and tail get a cache line each, producers only contend with
+    // producers and consumers with consumers
+    Separate,
+};
+
+template<typename T>
+constexpr uint64_t mpmc_default_capacity = ring_slots_in_8mb<sizeof(std::atomic<uint64_t>) + sizeof(T)>;
+
+// Bounded multi-producer multi-consumer queue with a sequence number per
+// slot (Vyukov). Producers claim a position with a CAS on tail, consumers
+// with a CAS on head, and the slot's sequence says whose turn it is:
+// pos means free for the producer claiming pos, pos + 1 means it holds the
+// message pushed at pos. A consumer frees a slot by moving its sequence
+// one lap ahead.
+//
+// Capacity is the ring size in slots, rounded up to a power of two. All
+// slots are usable.
+// Wait is the policy wait_pop uses while the queue is empty, see wait_policy.hpp.
+// Indices selects whether head and tail share a cache line.
+// Storage selects a heap ring or one embedded in the queue for shared memory,
+// see queue_storage.hpp.
+template<
+    QueueMsg T,
+    uint64_t Capacity = mpmc_default_capacity<T>,
+    typename Wait = SpinWait,
+    IndexLayout Indices = IndexLayout::Separate,
+    typename Storage = HeapStorage
+>
+class MPMCQueue {
+public:
+    using value_type = T;
+
+    MPMCQueue() {
+        init_sequences();
+    }
+
+    explicit MPMCQueue(const RingAllocOptions& options)
+        requires std::is_same_v<Storage, HeapStorage>
+    : slots{options}
+    {
+        init_sequences();
+    }
+
+    MPMCQueue(const MPMCQueue&) = delete;
+    MPMCQueue(MPMCQueue&&) = delete;
+
+    MPMCQueue& operator=(const MPMCQueue&) = delete;
+    MPMCQueue& operator=(MPMCQueue&&) = delete;
+
+    // any thread, false when the queue is full
+    bool try_push(const T& val);
+
+    // any thread, false when the queue is empty
+    bool try_pop(T& dst);
+    // blocks according to the Wait policy until a message is available
+    void wait_pop(T& dst);
+    // pops up to dst.size() messages, one claim each, stops at the first miss
+    size_t try_pop_burst(std::span<T> dst);
+
+private:
+    struct alignas(64) Slot {
+        std::atomic<uint64_t> sequence;
+        T data;
+    };
+
+    struct SharedIndices {
+        alignas(64) std::atomic<uint64_t> head{0};
+        std::atomic<uint64_t> tail{0};
+    };
+
+    struct SeparateIndices {
+        // contended by the consumers
+        alignas(64) std::atomic<uint64_t> head{0};
+        // contended by the producers
+        alignas(64) std::atomic<uint64_t> tail{0};
+    };
+
+    void init_sequences() {
+        for (uint64_t i = 0; i < buffer_size; ++i) {
+            slots[i].sequence.store(i, std::memory_order_relaxed);
+        }
+    }
+
+    constexpr static uint64_t buffer_size {std::bit_ceil(Capacity)};
+    constexpr static uint64_t wrap_mask {buffer_size - 1};
+
+    typename Storage::template Array<Slot, buffer_size> slots;
+    std::conditional_t<Indices == IndexLayout::Separate, SeparateIndices, SharedIndices> index;
+    [[no_unique_address]] Wait wait;
+
+    static_assert(buffer_size >= 2);
+    static_assert(std::popcount(buffer_size) == 1);
+};
+
+template<QueueMsg T, uint64_t Capacity, typename Wait, IndexLayout Indices, typename Storage>
+inline bool MPMCQueue<T, Capacity, Wait, Indices, Storage>::try_push(const T& val) {
+    uint64_t pos = index.tail.load(std::memory_order_relaxed);
+    Slot* slot;
+    while (true) {
+        slot = &slots[pos & wrap_mask];
+        uint64_t seq = slot->sequence.load(std::memory_order_acquire);
+        auto diff = static_cast<int64_t>(seq - pos);
+
+        if (diff == 0) {
+            // on failure pos is reloaded with the current tail
+            if (index.tail.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+                break;
+            }
+        } else if (diff < 0) {
+            // no consumer has freed this slot from the previous lap
+            return false;
+        } else {
+            // another producer claimed pos in the meantime
+            pos = index.tail.load(std::memory_order_relaxed);
+        }
+    }
+
+    slot->data = val;
+    slot->sequence.store(pos + 1, std::memory_order_release);
+    wait.notify();
+    return true;
+}
+
+template<QueueMsg T, uint64_t Capacity, typename Wait, IndexLayout Indices, typename Storage>
+inline bool MPMCQueue<T, Capacity, Wait, Indices, Storage>::try_pop(T& dst) {
+    uint64_t pos = index.head.load(std::memory_order_relaxed);
+    Slot* slot;
+    while (true) {
+        slot = &slots[pos & wrap_mask];
+        uint64_t seq = slot->sequence.load(std::memory_order_acquire);
+        auto diff = static_cast<int64_t>(seq - (pos + 1));
+
+        if (diff == 0) {
+            // on failure pos is reloaded with the current head
+            if (index.head.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+                break;
+            }
+        } else if (diff < 0) {
+            // the message for pos is not published yet
+            return false;
+        } else {
+            // another consumer took pos in the meantime
+            pos = index.head.load(std::memory_order_relaxed);
+        }
+    }
+
+    dst = slot->data;
+    // free for the producer that claims this slot one lap later
+    slot->sequence.store(pos + buffer_size, std::memory_order_release);
+    return true;
+}
+
+template<QueueMsg T, uint64_t Capacity, typename Wait, IndexLayout Indices, typename Storage>
+inline void MPMCQueue<T, Capacity, Wait, Indices, Storage>::wait_pop(T& dst) {
+    // the producer that publishes the next message writes this sequence,
+    // if another consumer takes it first the wait policy times out or retries
+    const void* watch = &slots[index.head.load(std::memory_order_relaxed) & wrap_mask].sequence;
+    wait.wait(watch, [&] { return try_pop(dst); });
+}
+
+template<QueueMsg T, uint64_t Capacity, typename Wait, IndexLayout Indices, typename Storage>
+inline size_t MPMCQueue<T, Capacity, Wait, Indices, Storage>::try_pop_burst(std::span<T> dst) {
+    size_t n = 0;
+    while (n < dst.size() && try_pop(dst[n])) {
+        ++n;
+    }
+    return n;
+}
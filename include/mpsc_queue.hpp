@@ -0,0 +1,241 @@
+#pragma once
+
+#include <atomic>
+#include <algorithm>
+#include <bit>
+#include <cstdint>
+#include <cstring>
+#include <new>
+#include <span>
+#include <type_traits>
+#include "queue_storage.hpp"
+#include "wait_policy.hpp"
+
+template<typename T>
+constexpr size_t mpsc_default_capacity = ring_slots_in_8mb<sizeof(std::atomic<size_t>) + sizeof(T)>;
+
+// Bounded multi-producer single-consumer queue with a sequence number per
+// slot (Vyukov). Producers claim a slot with one CAS on the shared tail and
+// publish it through the slot's sequence, the consumer never touches a
+// shared index: its position is private and it frees slots by bumping
+// their sequence by one lap.
+//
+// Capacity is the ring size in slots, rounded up to a power of two. All
+// slots are usable. Wait is the policy wait_pop uses while the queue is
+// empty, see wait_policy.hpp. Storage selects a heap or embedded ring,
+// see queue_storage.hpp.
+template<
+    typename T,
+    size_t Capacity = mpsc_default_capacity<T>,
+    typename Wait = SpinWait,
+    typename Storage = HeapStorage
+>
+class MPSCQueue {
+public:
+    using value_type = T;
+
+    MPSCQueue() {
+        init_sequences();
+    }
+
+    explicit MPSCQueue(const RingAllocOptions& options)
+        requires std::is_same_v<Storage, HeapStorage>
+    : buffer_{options}
+    {
+        init_sequences();
+    }
+
+    MPSCQueue(const MPSCQueue& q) = delete;
+    MPSCQueue(MPSCQueue&& q) = delete;
+
+    MPSCQueue& operator=(const MPSCQueue& q) = delete;
+    MPSCQueue& operator=(MPSCQueue&& q) = delete;
+
+    // any thread
+    bool try_push(const T& data);
+    bool try_push(T&& data);
+    template<typename... Args>
+    bool try_emplace(Args&&... args);
+
+    // consumer thread only
+    bool try_pop(T& dst);
+    // blocks according to the Wait policy until an element is available
+    void wait_pop(T& dst);
+    // pops up to dst.size() elements that are already published, in order.
+    // Finds the published run first, then copies it, then frees its slots.
+    // There is no shared head to publish once, each slot still gets its own
+    // release store, so this saves less than SPMCQueue's pop_bulk.
+    size_t try_pop_burst(std::span<T> dst);
+
+    // trivial for trivial T, so an embedded queue can stay in shared memory
+    ~MPSCQueue() requires std::is_trivially_destructible_v<T> = default;
+    ~MPSCQueue() {
+        while (buffer_[head_ & wrapMask_].sequence.load(std::memory_order_acquire) == head_ + 1) {
+            std::launder(reinterpret_cast<T*>(buffer_[head_ & wrapMask_].storage))->~T();
+            ++head_;
+        }
+    }
+
+private:
+    struct alignas(64) Slot {
+        // pos: free for the producer claiming pos, pos + 1: holds the element pushed at pos
+        std::atomic<size_t> sequence;
+        alignas(T) std::byte storage[sizeof(T)];
+    };
+
+    void init_sequences() {
+        for (size_t i = 0; i < bufferSizeSlots_; ++i) {
+            buffer_[i].sequence.store(i, std::memory_order_relaxed);
+        }
+    }
+
+    // claims the slot for the next position, nullptr when full
+    Slot* claim(size_t& pos);
+    void publish(Slot& slot, size_t pos);
+    void take(Slot& slot, T& dst);
+
+    static_assert(Capacity >= 2);
+    static constexpr size_t bufferSizeSlots_ = std::bit_ceil(Capacity);
+    static constexpr size_t wrapMask_ = bufferSizeSlots_ - 1;
+    typename Storage::template Array<Slot, bufferSizeSlots_> buffer_;
+
+    // contended by all producers
+    alignas(64) std::atomic<size_t> tail_ = 0;
+    // consumer-local
+    alignas(64) size_t head_ = 0;
+
+    [[no_unique_address]] Wait wait_;
+};
+
+template<typename T, size_t Capacity, typename Wait, typename Storage>
+auto MPSCQueue<T, Capacity, Wait, Storage>::claim(size_t& pos) -> Slot* {
+    pos = tail_.load(std::memory_order_relaxed);
+    while (true) {
+        Slot& slot = buffer_[pos & wrapMask_];
+        size_t seq = slot.sequence.load(std::memory_order_acquire);
+        auto diff = static_cast<std::make_signed_t<size_t>>(seq - pos);
+
+        if (diff == 0) {
+            // on failure pos is reloaded with the current tail
+            if (tail_.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+                return &slot;
+            }
+        } else if (diff < 0) {
+            // the consumer has not freed this slot from the previous lap
+            return nullptr;
+        } else {
+            // another producer claimed pos in the meantime
+            pos = tail_.load(std::memory_order_relaxed);
+        }
+    }
+}
+
+template<typename T, size_t Capacity, typename Wait, typename Storage>
+void MPSCQueue<T, Capacity, Wait, Storage>::publish(Slot& slot, size_t pos) {
+    slot.sequence.store(pos + 1, std::memory_order_release);
+    wait_.notify();
+}
+
+template<typename T, size_t Capacity, typename Wait, typename Storage>
+bool MPSCQueue<T, Capacity, Wait, Storage>::try_push(const T& data) {
+    size_t pos;
+    Slot* slot = claim(pos);
+    if (!slot) {
+        return false;
+    }
+
+    if constexpr (std::is_trivially_copyable_v<T>) {
+        std::memcpy(slot->storage, &data, sizeof(T));
+    } else {
+        new (slot->storage) T(data);
+    }
+
+    publish(*slot, pos);
+    return true;
+}
+
+template<typename T, size_t Capacity, typename Wait, typename Storage>
+bool MPSCQueue<T, Capacity, Wait, Storage>::try_push(T&& data) {
+    size_t pos;
+    Slot* slot = claim(pos);
+    if (!slot) {
+        return false;
+    }
+
+    if constexpr (std::is_trivially_copyable_v<T>) {
+        std::memcpy(slot->storage, &data, sizeof(T));
+    } else {
+        new (slot->storage) T(std::move(data));
+    }
+
+    publish(*slot, pos);
+    return true;
+}
+
+template<typename T, size_t Capacity, typename Wait, typename Storage>
+template<typename... Args>
+bool MPSCQueue<T, Capacity, Wait, Storage>::try_emplace(Args&&... args) {
+    size_t pos;
+    Slot* slot = claim(pos);
+    if (!slot) {
+        return false;
+    }
+
+    new (slot->storage) T(std::forward<Args>(args)...);
+
+    publish(*slot, pos);
+    return true;
+}
+
+template<typename T, size_t Capacity, typename Wait, typename Storage>
+void MPSCQueue<T, Capacity, Wait, Storage>::take(Slot& slot, T& dst) {
+    if constexpr (std::is_trivially_copyable_v<T>) {
+        std::memcpy(&dst, slot.storage, sizeof(T));
+    } else {
+        T* ptr = std::launder(reinterpret_cast<T*>(slot.storage));
+        dst = std::move(*ptr);
+        ptr->~T();
+    }
+}
+
+template<typename T, size_t Capacity, typename Wait, typename Storage>
+bool MPSCQueue<T, Capacity, Wait, Storage>::try_pop(T& dst) {
+    Slot& slot = buffer_[head_ & wrapMask_];
+    if (slot.sequence.load(std::memory_order_acquire) != head_ + 1) {
+        return false;
+    }
+
+    take(slot, dst);
+
+    // free for the producer that claims this slot one lap later
+    slot.sequence.store(head_ + bufferSizeSlots_, std::memory_order_release);
+    ++head_;
+    return true;
+}
+
+template<typename T, size_t Capacity, typename Wait, typename Storage>
+void MPSCQueue<T, Capacity, Wait, Storage>::wait_pop(T& dst) {
+    // the next producer to publish writes the sequence of this slot
+    const void* watch = &buffer_[head_ & wrapMask_].sequence;
+    wait_.wait(watch, [&] { return try_pop(dst); });
+}
+
+template<typename T, size_t Capacity, typename Wait, typename Storage>
+size_t MPSCQueue<T, Capacity, Wait, Storage>::try_pop_burst(std::span<T> dst) {
+    // producers can publish out of order, the run stops at the first
+    // claimed but unpublished slot
+    size_t n = 0;
+    while (n < dst.size() &&
+           buffer_[(head_ + n) & wrapMask_].sequence.load(std::memory_order_acquire) == head_ + n + 1) {
+        ++n;
+    }
+
+    for (size_t i = 0; i < n; ++i) {
+        take(buffer_[(head_ + i) & wrapMask_], dst[i]);
+    }
+    for (size_t i = 0; i < n; ++i) {
+        buffer_[(head_ + i) & wrapMask_].sequence.store(head_ + i + bufferSizeSlots_, std::memory_order_release);
+    }
+    head_ += n;
+    return n;
+}
@@ -0,0 +1,67 @@
+#pragma once
+#include <cstdint>
+#include <optional>
+#include <string>
+#include <utility>
+#include <vector>
+
+// a perf_event_attr type/config pair, e.g. PERF_TYPE_RAW with 0x04d2
+struct PerfEvent {
+    std::string name;
+    uint32_t type;
+    uint64_t config;
+};
+
+struct PerfCount {
+    std::string name;
+    uint64_t value;
+};
+
+// cycles, instructions, L1D and LLC load misses, and on Intel loads that hit
+// a line modified in another core's cache (MEM_LOAD_L3_HIT_RETIRED.XSNP_HITM,
+// XSNP_FWD from Golden Cove on), the cost of a contended cache line
+std::vector<PerfEvent> default_perf_events();
+
+// A perf_event_open() group counting the calling thread in user space only.
+// Open, start, stop and read it on the thread being measured.
+class PerfCounters {
+public:
+    // nullopt, with a warning on stderr, when the kernel refuses the first
+    // event (no PMU in a VM, perf_event_paranoid > 2); events the CPU does
+    // not have are left out of the group
+    static std::optional<PerfCounters> open(const std::vector<PerfEvent>& events = default_perf_events());
+
+    PerfCounters(PerfCounters&& other) noexcept;
+    PerfCounters& operator=(PerfCounters&& other) noexcept;
+    PerfCounters(const PerfCounters&) = delete;
+    PerfCounters& operator=(const PerfCounters&) = delete;
+    ~PerfCounters();
+
+    // zeroes the counts and starts the whole group at once
+    void start();
+    void stop();
+    // counts since start(), scaled up when the kernel multiplexed the group
+    std::vector<PerfCount> read() const;
+
+private:
+    PerfCounters(std::vector<int> fds, std::vector<std::string> names)
+    : fds_{std::move(fds)}, names_{std::move(names)}
+    {}
+
+    void close_all();
+
+    // fds_[0] leads the group
+    std::vector<int> fds_;
+    std::vector<std::string> names_;
+};
+
+struct ThreadPerfCounts {
+    std::string thread;
+    // messages the thread handled, for per message counts
+    uint64_t messages;
+    std::vector<PerfCount> counts;
+};
+
+// prints every thread's counts, total and per message, and writes them as
+// thread,event,count,per_message rows to file_name
+void report_perf_counts(const std::vector<ThreadPerfCounts>& threads, const std::string& file_name);
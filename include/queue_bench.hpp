@@ -0,0 +1,375 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <concepts>
+#include <cstdint>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <optional>
+#include <span>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+#include <x86intrin.h>
+
+#include "bench_messages.hpp"
+#include "benchmark_utils.hpp"
+#include "latency_histogram.hpp"
+#include "load_generator.hpp"
+#include "perf_counters.hpp"
+
+// One latency/throughput harness for every queue: same pinning, payloads,
+// sampling and reports. A queue takes part through an adapter, see
+// bench_adapters.hpp for the ones in this repo.
+
+// the producer side of a queue, false when the queue is full
+template<typename P, typename T>
+concept ProducerEndpoint = requires(P& p, const T& value) {
+    { p.try_push(value) } -> std::same_as<bool>;
+};
+
+// one consumer's side of a queue, false when there is nothing to read
+template<typename C, typename T>
+concept ConsumerEndpoint = requires(C& c, T& dst) {
+    { c.try_pop(dst) } -> std::same_as<bool>;
+};
+
+// a consumer that can take several messages per call
+template<typename C, typename T>
+concept BurstConsumerEndpoint = ConsumerEndpoint<C, T> && requires(C& c, std::span<T> dst) {
+    { c.try_pop_burst(dst) } -> std::same_as<std::size_t>;
+};
+
+// Default constructible adapter owning the queue. producer() is called once,
+// make_consumer() once per consumer before any message is pushed.
+// fan_out: every consumer receives every message, otherwise each message
+// goes to one consumer. max_consumers caps the consumer count.
+template<typename Q>
+concept BenchQueue = std::default_initializable<Q> && requires(Q& q) {
+    typename Q::value_type;
+    { q.producer() } -> ProducerEndpoint<typename Q::value_type>;
+    { q.make_consumer() } -> ConsumerEndpoint<typename Q::value_type>;
+    { Q::fan_out } -> std::convertible_to<bool>;
+    { Q::max_consumers } -> std::convertible_to<int>;
+};
+
+// a message that carries its send time, for end-to-end runs
+template<typename T>
+concept StampedMessage = requires(T& msg) {
+    { msg.sent_tsc } -> std::convertible_to<uint64_t>;
+};
+
+constexpr std::size_t queue_bench_messages = 2'000'000;
+// the producer runs here, consumer i on producer_cpu + 1 + i
+constexpr int queue_bench_producer_cpu = 1;
+
+struct QueueBenchOptions {
+    int consumers = 1;
+    // messages per pop call, needs a BurstConsumerEndpoint above 1
+    std::size_t burst = 1;
+    std::size_t messages = queue_bench_messages;
+    // record push-to-pop time from the TSC stamped into each message instead
+    // of the cost of each pop call, needs a StampedMessage
+    bool end_to_end = false;
+    // Open loop: push message i no earlier than its intended send time and
+    // stamp that time, so end-to-end latency includes any delay before the
+    // push. Needs at least messages entries. nullptr pushes back to back.
+    const SendSchedule* schedule = nullptr;
+    // count cycles, instructions, cache misses and HITMs on every thread
+    // over its push or pop loop, so contention shows on the side causing it
+    bool perf_counters = false;
+};
+
+struct QueueBenchResult {
+    // messages per second from the first push to the last pop
+    double throughput;
+    // every consumer's pop cost or end-to-end latency, in cycles
+    LatencyHistogram consumers;
+};
+
+// Pushes options.messages messages from this thread and pops them on
+// pinned consumer threads. Push cost, and pop cost or end-to-end latency,
+// go to push.csv and consumer_latency_<id>.csv, end-to-end throughput to
+// stdout, and all consumers merged to consumers.hgrm, which is also returned.
+// Per-thread perf counts, when asked for, go to stdout and perf.csv. The
+// files are written to ../results/<label>/, or ../results/ for label "", so
+// plotting ../results only picks up the unlabelled run.
+template<BenchQueue Queue>
+QueueBenchResult run_queue_bench(const std::string& label, const QueueBenchOptions& options = {}) {
+    using T = typename Queue::value_type;
+    using Consumer = decltype(std::declval<Queue&>().make_consumer());
+
+    const int consumer_count = options.consumers;
+    const std::size_t burst = options.burst;
+    const std::size_t message_count = options.messages;
+
+    if (consumer_count < 1 || consumer_count > Queue::max_consumers) {
+        throw std::invalid_argument("consumer_count out of range for " + label);
+    }
+    if (burst < 1 || (burst > 1 && !BurstConsumerEndpoint<Consumer, T>)) {
+        throw std::invalid_argument("burst pops are not supported by " + label);
+    }
+    if (options.end_to_end && !StampedMessage<T>) {
+        throw std::invalid_argument("end-to-end runs need a message with sent_tsc, " + label + " has none");
+    }
+    if (options.schedule && options.schedule->size() < message_count) {
+        throw std::invalid_argument("send schedule of " + label + " is shorter than the run");
+    }
+
+    pin_thread_to_cpu(queue_bench_producer_cpu);
+    if (options.end_to_end) {
+        // consumers subtract stamps taken on the producer's core
+        std::vector<int> cpus;
+        for (int id = 0; id < consumer_count; ++id) {
+            cpus.push_back(queue_bench_producer_cpu + 1 + id);
+        }
+        check_tsc_sync(queue_bench_producer_cpu, cpus);
+    }
+
+    auto queue = std::make_unique<Queue>();
+
+    // cap the source data at 64MB so large messages don't need GBs of input,
+    // 16 byte messages are still all distinct
+    const std::size_t distinct = std::min<std::size_t>(message_count, (64 << 20) / sizeof(T));
+    auto messages = make_messages<T>(distinct);
+
+    std::vector<Consumer> consumers;
+    consumers.reserve(consumer_count);
+    for (int i = 0; i < consumer_count; ++i) {
+        consumers.push_back(queue->make_consumer());
+    }
+    auto&& producer = queue->producer();
+
+    // fixed size, so long runs cost no more memory than short ones
+    std::vector<LatencyHistogram> pop_latency(consumer_count);
+    // [0] is the producer, [1 + id] consumer id
+    std::vector<ThreadPerfCounts> perf(consumer_count + 1);
+    std::atomic<uint64_t> received{0};
+    std::atomic<bool> producer_done{false};
+    std::atomic<int> ready{0};
+
+    std::vector<std::thread> threads;
+    threads.reserve(consumer_count);
+    for (int id = 0; id < consumer_count; ++id) {
+        threads.emplace_back([&, id] {
+            pin_thread_to_cpu(queue_bench_producer_cpu + 1 + id);
+            auto& consumer = consumers[id];
+            auto& latency = pop_latency[id];
+
+            std::vector<T> batch(burst);
+            auto counters = options.perf_counters ? PerfCounters::open() : std::nullopt;
+            ready.fetch_add(1, std::memory_order_release);
+            if (counters) {
+                counters->start();
+            }
+
+            unsigned aux;
+            uint64_t got = 0;
+            while (true) {
+                // read before popping: an empty pop after the flag was set
+                // means the queue really is drained
+                const bool done = !Queue::fan_out && producer_done.load(std::memory_order_acquire);
+                auto t0 = __rdtscp(&aux);
+                std::size_t n;
+                if constexpr (BurstConsumerEndpoint<Consumer, T>) {
+                    n = burst == 1 ? consumer.try_pop(batch[0]) : consumer.try_pop_burst(std::span<T>(batch));
+                } else {
+                    n = consumer.try_pop(batch[0]);
+                }
+
+                if (n > 0) {
+                    auto t1 = __rdtscp(&aux);
+                    if constexpr (StampedMessage<T>) {
+                        if (options.end_to_end) {
+                            for (std::size_t k = 0; k < n; ++k) {
+                                latency.record(t1 - batch[k].sent_tsc);
+                            }
+                        } else {
+                            latency.record(t1 - t0);
+                        }
+                    } else {
+                        latency.record(t1 - t0);
+                    }
+                    got += n;
+                }
+
+                if constexpr (Queue::fan_out) {
+                    if (got == message_count) {
+                        break;
+                    }
+                } else if (n == 0 && done) {
+                    break;
+                }
+            }
+            if (counters) {
+                counters->stop();
+                perf[1 + id] = {"consumer_" + std::to_string(id), got, counters->read()};
+            }
+            received.fetch_add(got, std::memory_order_relaxed);
+        });
+    }
+
+    while (ready.load(std::memory_order_acquire) != consumer_count) {
+    }
+
+    LatencyHistogram push_latency;
+    auto counters = options.perf_counters ? PerfCounters::open() : std::nullopt;
+    if (counters) {
+        counters->start();
+    }
+    const auto begin = std::chrono::steady_clock::now();
+
+    unsigned aux;
+    const uint64_t start = __rdtscp(&aux);
+    std::size_t i = 0;
+    while (i < message_count) {
+        uint64_t intended = 0;
+        if (options.schedule) {
+            // a late producer sends right away, it never skips ahead
+            intended = start + (*options.schedule)[i];
+            while (__rdtscp(&aux) < intended) {
+                _mm_pause();
+            }
+        }
+
+        T& msg = messages[i % distinct];
+        while (true) {
+            auto t0 = __rdtscp(&aux);
+            if constexpr (StampedMessage<T>) {
+                msg.sent_tsc = options.schedule ? intended : t0;
+            }
+            bool pushed = producer.try_push(msg);
+            if (pushed) {
+                auto t1 = __rdtscp(&aux);
+                push_latency.record(t1 - t0);
+                ++i;
+                break;
+            }
+        }
+    }
+    producer_done.store(true, std::memory_order_release);
+    if (counters) {
+        counters->stop();
+        perf[0] = {"producer", message_count, counters->read()};
+    }
+
+    for (auto& thread : threads) {
+        thread.join();
+    }
+    const double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - begin).count();
+
+    const uint64_t expected = Queue::fan_out ? message_count * consumer_count : message_count;
+    if (received.load() != expected) {
+        throw std::runtime_error(
+            label + ": consumers received " + std::to_string(received.load()) + " of " + std::to_string(expected) + " messages"
+        );
+    }
+
+    const std::string suffix = label.empty() ? "" : "_" + label;
+    const std::string dir = label.empty() ? "../results/" : "../results/" + label + "/";
+    std::filesystem::create_directories(dir);
+    std::cout << "queue bench" << (label.empty() ? "" : " (" + label + ")") << ", consumers: " << consumer_count
+              << ", messages per pop: " << burst << ", sizeof message: " << sizeof(T)
+              << ", consumer latency: " << (options.end_to_end ? "push to pop" : "pop call") << '\n';
+    const double throughput = message_count / elapsed;
+    std::cout << "end-to-end throughput (msgs/s): " << static_cast<uint64_t>(throughput) << '\n';
+
+    export_latency_histogram_csv(push_latency, dir + "push.csv", "producer" + suffix);
+    LatencyHistogram all_consumers;
+    for (int id = 0; id < consumer_count; ++id) {
+        all_consumers.merge(pop_latency[id]);
+        export_latency_histogram_csv(
+            pop_latency[id],
+            dir + "consumer_latency_" + std::to_string(id) + ".csv",
+            "consumer_" + std::to_string(id) + suffix
+        );
+    }
+    export_latency_histogram_hgrm(all_consumers, dir + "consumers.hgrm");
+
+    std::erase_if(perf, [](const ThreadPerfCounts& thread) { return thread.counts.empty(); });
+    report_perf_counts(perf, dir + "perf.csv");
+    return {throughput, std::move(all_consumers)};
+}
+
+struct RateSweepOptions {
+    // consumers and burst of every run, end_to_end is always on
+    QueueBenchOptions run;
+    Arrivals arrivals = Arrivals::Constant;
+    // timestamp file for Arrivals::Replay, see SendSchedule::replay
+    std::string capture;
+    // offered rates in msgs/s: first_rate, first_rate * rate_step, ...
+    double first_rate = 100'000;
+    double rate_step = 2.0;
+    double max_rate = 1e9;
+    // length of each run, between 10k messages and run.messages
+    double seconds_per_rate = 0.5;
+    // a run is saturated when it delivers less than this share of the
+    // offered rate or its p99 goes above max_p99_ns
+    double min_delivered = 0.95;
+    uint64_t max_p99_ns = 1'000'000;
+};
+
+// Open-loop runs at increasing offered rates until the queue saturates.
+// Latency is measured from each message's intended send time, so the
+// queueing delay near saturation isn't hidden by a slowed producer. One
+// row per rate goes to ../results/rate_sweep[_label].csv, and the highest
+// rate that wasn't saturated (the latency knee) to stdout. Each run's own
+// files go to ../results/<label>/<rate>/.
+template<BenchQueue Queue>
+void run_rate_sweep(const std::string& label, const RateSweepOptions& options = {}) {
+    using T = typename Queue::value_type;
+    static_assert(StampedMessage<T>, "rate sweeps measure end to end and need a message with sent_tsc");
+
+    if (!(options.first_rate > 0.0) || !(options.rate_step > 1.0)) {
+        throw std::invalid_argument("rate sweep of " + label + " needs first_rate > 0 and rate_step > 1");
+    }
+
+    const uint64_t tsc_freq = tsc_frequency();
+    const std::string suffix = label.empty() ? "" : "_" + label;
+    const std::string file_name = "../results/rate_sweep" + suffix + ".csv";
+    std::ofstream out(file_name);
+    if (!out) {
+        throw std::runtime_error("can't open " + file_name);
+    }
+    out << "offered_rate,delivered_rate,p50_ns,p99_ns,p999_ns,max_ns\n";
+
+    double knee = 0.0;
+    bool saturated = false;
+    for (double rate = options.first_rate; rate <= options.max_rate; rate *= options.rate_step) {
+        QueueBenchOptions run = options.run;
+        run.end_to_end = true;
+        run.messages = std::clamp<std::size_t>(
+            static_cast<std::size_t>(rate * options.seconds_per_rate), 10'000, options.run.messages
+        );
+        const SendSchedule schedule = SendSchedule::make(options.arrivals, rate, run.messages, tsc_freq, options.capture);
+        run.schedule = &schedule;
+
+        const auto result = run_queue_bench<Queue>(label + "/" + std::to_string(static_cast<uint64_t>(rate)), run);
+        const uint64_t p99_ns = cycles_to_ns(result.consumers.percentile(0.99), tsc_freq);
+        out << static_cast<uint64_t>(rate) << ',' << static_cast<uint64_t>(result.throughput) << ','
+            << cycles_to_ns(result.consumers.percentile(0.50), tsc_freq) << ',' << p99_ns << ','
+            << cycles_to_ns(result.consumers.percentile(0.999), tsc_freq) << ','
+            << cycles_to_ns(result.consumers.max(), tsc_freq) << '\n';
+
+        if (result.throughput < options.min_delivered * rate || p99_ns > options.max_p99_ns) {
+            saturated = true;
+            break;
+        }
+        knee = rate;
+    }
+
+    std::cout << "rate sweep" << (label.empty() ? "" : " (" + label + ")") << ", latency knee (msgs/s): ";
+    if (!saturated) {
+        std::cout << "not reached up to " << static_cast<uint64_t>(knee) << '\n';
+    } else if (knee == 0.0) {
+        std::cout << "below " << static_cast<uint64_t>(options.first_rate) << '\n';
+    } else {
+        std::cout << static_cast<uint64_t>(knee) << '\n';
+    }
+}
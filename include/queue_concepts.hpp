@@ -0,0 +1,9 @@
+#pragma once
+
+#include <type_traits>
+
+// messages that can be copied with memcpy and overwritten in place
+template<typename T>
+concept QueueMsg =
+    std::is_trivially_copyable_v<T> &&
+    std::is_trivially_destructible_v<T>;
@@ -0,0 +1,73 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <type_traits>
+#include "ring_memory.hpp"
+
+// slots of SlotBytes, padded to whole cache lines, that fit in 8MB: the
+// default ring size of every queue
+template<size_t SlotBytes>
+constexpr uint64_t ring_slots_in_8mb = 8 * 1024 * 1024 / ((SlotBytes + 63) / 64 * 64);
+
+// Where a queue keeps its ring. Storage::Array<Slot, N> is a fixed array of
+// N value-initialized slots, aligned to at least a cache line.
+
+// The ring is allocated separately (an anonymous mapping), the queue object
+// itself stays small. Constructing it, or a queue using it, with
+// RingAllocOptions selects huge pages, NUMA binding, prefaulting and mlock,
+// see ring_memory.hpp.
+struct HeapStorage {
+    template<typename Slot, size_t N>
+    class Array {
+    public:
+        Array() : Array(RingAllocOptions{}) {}
+        explicit Array(const RingAllocOptions& options)
+        : memory_{N * sizeof(Slot), options},
+          slots_{construct(memory_.data())}
+        {}
+
+        ~Array() {
+            std::destroy_n(slots_, N);
+        }
+
+        Slot& operator[](size_t i) { return slots_[i]; }
+        const Slot& operator[](size_t i) const { return slots_[i]; }
+        // what the ring got, a Huge request may have fallen back
+        RingPages pages() const { return memory_.pages(); }
+
+    private:
+        static_assert(alignof(Slot) <= 4096, "the ring is only page aligned");
+
+        static Slot* construct(std::byte* memory) {
+            Slot* slots = reinterpret_cast<Slot*>(memory);
+            // the mapping is zero filled, so trivial slots need no writes and
+            // their pages are faulted in on first use unless prefaulted
+            if constexpr (std::is_trivially_default_constructible_v<Slot>) {
+                std::uninitialized_default_construct_n(slots, N);
+            } else {
+                std::uninitialized_value_construct_n(slots, N);
+            }
+            return slots;
+        }
+
+        RingMemory memory_;
+        Slot* slots_;
+    };
+};
+
+// The ring is part of the queue object and the queue holds no pointers, so
+// it can be placed in shared memory (see IPCChannel) and used by every
+// process that maps it, at whatever address.
+struct EmbeddedStorage {
+    template<typename Slot, size_t N>
+    class Array {
+    public:
+        Slot& operator[](size_t i) { return slots_[i]; }
+        const Slot& operator[](size_t i) const { return slots_[i]; }
+
+    private:
+        alignas(64) Slot slots_[N]{};
+    };
+};
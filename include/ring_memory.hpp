@@ -0,0 +1,187 @@
+#pragma once
+#include <cerrno>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <filesystem>
+#include <linux/mempolicy.h>
+#include <stdexcept>
+#include <string>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+enum class RingPages {
+    // regular 4K pages
+    Small,
+    // madvise(MADV_HUGEPAGE) on a 2M aligned mapping, THP must be enabled
+    TransparentHuge,
+    // MAP_HUGETLB from the reserved pool, falls back to TransparentHuge when it is empty
+    Huge,
+};
+
+// How a ring's memory is allocated. The defaults behave like a plain
+// allocation: 4K pages, placed by first touch, faulted in on first use.
+struct RingAllocOptions {
+    RingPages pages = RingPages::Small;
+    // NUMA node to bind the ring to (usually the consumer's), -1 for first touch
+    int numaNode = -1;
+    // fault every page in at construction instead of in the first pass
+    bool prefault = false;
+    // mlock the ring, needs a large enough RLIMIT_MEMLOCK
+    bool lock = false;
+};
+
+namespace ring_memory_detail {
+
+inline constexpr size_t hugePageSize = 2 * 1024 * 1024;
+
+[[noreturn]] inline void throw_errno(const std::string& what) {
+    throw std::runtime_error(what + " failed: " + std::strerror(errno));
+}
+
+inline size_t round_up(size_t size, size_t page) {
+    return (size + page - 1) / page * page;
+}
+
+// anonymous mapping of bytes, aligned to align
+inline std::byte* map_aligned(size_t bytes, size_t align) {
+    void* raw = mmap(nullptr, bytes + align, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (raw == MAP_FAILED) {
+        throw_errno("mmap ring");
+    }
+
+    auto start = reinterpret_cast<uintptr_t>(raw);
+    uintptr_t aligned = (start + align - 1) / align * align;
+    if (aligned != start) {
+        munmap(raw, aligned - start);
+    }
+    munmap(reinterpret_cast<void*>(aligned + bytes), start + align - aligned);
+
+    return reinterpret_cast<std::byte*>(aligned);
+}
+
+}  // namespace ring_memory_detail
+
+// numaNode, prefault and lock for memory mapped elsewhere, e.g. a mirrored ring
+inline void prepare_ring_memory(std::byte* data, size_t bytes, const RingAllocOptions& options) {
+    // bind before anything touches the pages, so they are allocated on the node
+    if (options.numaNode >= 0) {
+        unsigned long mask[16] = {};
+        const size_t maskBits = sizeof(mask) * 8;
+        if (static_cast<size_t>(options.numaNode) >= maskBits) {
+            throw std::invalid_argument("numa node out of range");
+        }
+        mask[options.numaNode / 64] |= 1ul << (options.numaNode % 64);
+
+        if (syscall(SYS_mbind, data, bytes, MPOL_BIND, mask, maskBits, MPOL_MF_MOVE) != 0) {
+            ring_memory_detail::throw_errno("mbind to node " + std::to_string(options.numaNode));
+        }
+    }
+
+    if (options.prefault) {
+        // MADV_POPULATE_WRITE needs 5.14, touching every page works everywhere
+        if (madvise(data, bytes, MADV_POPULATE_WRITE) != 0) {
+            const size_t pageSize = static_cast<size_t>(sysconf(_SC_PAGESIZE));
+            for (size_t offset = 0; offset < bytes; offset += pageSize) {
+                reinterpret_cast<volatile std::byte*>(data)[offset] = std::byte{0};
+            }
+        }
+    }
+
+    if (options.lock && mlock(data, bytes) != 0) {
+        ring_memory_detail::throw_errno("mlock ring");
+    }
+}
+
+// NUMA node of a CPU according to sysfs, 0 on machines without NUMA
+inline int numa_node_of_cpu(int cpu) {
+    namespace fs = std::filesystem;
+
+    std::error_code ec;
+    const fs::path cpuDir = "/sys/devices/system/cpu/cpu" + std::to_string(cpu);
+    for (const auto& entry : fs::directory_iterator(cpuDir, ec)) {
+        const std::string name = entry.path().filename().string();
+        if (name.starts_with("node")) {
+            return std::stoi(name.substr(4));
+        }
+    }
+    return 0;
+}
+
+// Anonymous, zero-filled, page aligned memory for a ring.
+// Throws std::runtime_error if a requested option can not be applied.
+class RingMemory {
+public:
+    RingMemory(size_t bytes, const RingAllocOptions& options) {
+        using namespace ring_memory_detail;
+
+        if (options.pages == RingPages::Huge) {
+            size_ = round_up(bytes, hugePageSize);
+            void* data = mmap(nullptr, size_, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+            if (data != MAP_FAILED) {
+                data_ = static_cast<std::byte*>(data);
+                pages_ = RingPages::Huge;
+            }
+        }
+
+        if (!data_ && options.pages != RingPages::Small) {
+            size_ = round_up(bytes, hugePageSize);
+            data_ = map_aligned(size_, hugePageSize);
+            if (madvise(data_, size_, MADV_HUGEPAGE) != 0) {
+                int err = errno;
+                munmap(data_, size_);
+                errno = err;
+                throw_errno("madvise(MADV_HUGEPAGE)");
+            }
+            pages_ = RingPages::TransparentHuge;
+        }
+
+        if (!data_) {
+            const size_t pageSize = static_cast<size_t>(sysconf(_SC_PAGESIZE));
+            size_ = round_up(bytes, pageSize);
+            data_ = map_aligned(size_, pageSize);
+        }
+
+        try {
+            prepare_ring_memory(data_, size_, options);
+        } catch (...) {
+            munmap(data_, size_);
+            throw;
+        }
+    }
+
+    ~RingMemory() {
+        munmap(data_, size_);
+    }
+
+    RingMemory(const RingMemory&) = delete;
+    RingMemory(RingMemory&&) = delete;
+
+    RingMemory& operator=(const RingMemory&) = delete;
+    RingMemory& operator=(RingMemory&&) = delete;
+
+    std::byte* data() const { return data_; }
+    size_t size() const { return size_; }
+    // backed by the hugetlb pool rather than THP or small pages
+    bool huge_pages() const { return pages_ == RingPages::Huge; }
+    // the pages the ring got, Huge may have fallen back to TransparentHuge
+    RingPages pages() const { return pages_; }
+
+private:
+    std::byte* data_ = nullptr;
+    size_t size_ = 0;
+    RingPages pages_ = RingPages::Small;
+};
+
+inline const char* ring_pages_name(RingPages pages) {
+    switch (pages) {
+        case RingPages::Small:
+            return "4K pages";
+        case RingPages::TransparentHuge:
+            return "transparent huge pages";
+        case RingPages::Huge:
+            return "hugetlb pages";
+    }
+    return "unknown";
+}
@@ -0,0 +1,43 @@
+#pragma once
+#include <cstddef>
+#include <optional>
+#include <string>
+
+enum class ShmBacking {
+    // hugetlbfs when it is mounted and has free pages, shm_open otherwise
+    Auto,
+    Pages4K,
+    HugePages,
+};
+
+// A named shared memory file mapped into this process, either a shm_open()
+// object ("/dev/shm/<name>") or a file on hugetlbfs ("/dev/hugepages/<name>").
+// The file outlives the mapping until unlink(name).
+class SharedSegment {
+public:
+    // creates the file exclusively and maps size bytes (rounded up to the page size),
+    // nullopt if name already exists
+    static std::optional<SharedSegment> create(const std::string& name, size_t size, ShmBacking backing);
+    // nullopt if name does not exist yet or its creator has not sized it yet
+    static std::optional<SharedSegment> open_existing(const std::string& name);
+    static void unlink(const std::string& name);
+
+    SharedSegment(SharedSegment&& other) noexcept;
+    SharedSegment& operator=(SharedSegment&& other) noexcept;
+    SharedSegment(const SharedSegment&) = delete;
+    SharedSegment& operator=(const SharedSegment&) = delete;
+    ~SharedSegment();
+
+    std::byte* data() const { return data_; }
+    size_t size() const { return size_; }
+    bool huge_pages() const { return hugePages_; }
+
+private:
+    SharedSegment(std::byte* data, size_t size, bool hugePages)
+    : data_{data}, size_{size}, hugePages_{hugePages}
+    {}
+
+    std::byte* data_ = nullptr;
+    size_t size_ = 0;
+    bool hugePages_ = false;
+};
@@ -1,3 +1,7 @@
 #pragma once
 
 void run_spmc_burst_bench(int consumer_count);
+void run_spmc_burst_bench_bulk(int consumer_count);
+void run_spmc_ring_size_sweep(int consumer_count);
+void run_spmc_version_layout_bench(int consumer_count);
+void run_spmc_alloc_bench(int consumer_count);
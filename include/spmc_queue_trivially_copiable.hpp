@@ -1,14 +1,16 @@
 #pragma once
 
 #include <atomic>
+#include <algorithm>
 #include <memory>
 #include <iostream>
+#include <cstddef>
 #include <cstring>
-
-template<typename T>
-concept QueueMsg =
-    std::is_trivially_copyable_v<T> &&
-    std::is_trivially_destructible_v<T>;
+#include <bit>
+#include <span>
+#include "queue_concepts.hpp"
+#include "queue_storage.hpp"
+#include "wait_policy.hpp"
 
 // no micro op cache polution
 [[gnu::noinline, gnu::cold]] static void unexpected_abort() {
@@ -16,16 +18,95 @@ concept QueueMsg =
     std::abort();
 };
 
-[[gnu::always_inline]] inline void UNEXPECTED(bool condition) {
-    if (condition) [[unlikely]] {
-        unexpected_abort();
+// what a consumer does once the producer has lapped it
+enum class OverrunPolicy {
+    // std::abort(), the producer can never be held back by a consumer
+    Abort,
+    // report the loss and continue from the oldest message still in the ring
+    Resync,
+    // report the loss and continue from the newest published message
+    JumpToNewest,
+};
+
+struct PopResult {
+    enum class Status : uint8_t {
+        Empty,
+        Ok,
+        Overrun,
+    };
+
+    Status status;
+    // messages skipped, only non-zero for Overrun
+    uint64_t lost;
+
+    explicit operator bool() const {
+        return status == Status::Ok;
     }
-}
+};
 
-template<QueueMsg T>
+// how consumers copy the payload out of a slot
+enum class SeqlockRead {
+    // plain copy, a data race by the C++ standard but fine on x86
+    Racy,
+    // word-sized std::atomic_ref copies, standards-correct and TSAN-clean
+    Atomic,
+};
+
+// where the seqlock versions live
+enum class VersionLayout {
+    // each 64 byte slot holds its version and its payload
+    InSlot,
+    // versions are packed 8 to a cache line in their own array and payloads
+    // are packed back to back, so polling consumers touch one line per 8 slots
+    Separate,
+};
+
+#ifdef SPMC_PORTABLE_SEQLOCK
+constexpr SeqlockRead default_seqlock_read = SeqlockRead::Atomic;
+#else
+constexpr SeqlockRead default_seqlock_read = SeqlockRead::Racy;
+#endif
+
+template<typename T>
+constexpr uint64_t spmc_default_capacity = ring_slots_in_8mb<sizeof(std::atomic<uint64_t>) + sizeof(T)>;
+
+// Capacity is the ring size in slots, rounded up to a power of two.
+// Wait is the policy Consumer::wait_pop uses while the queue is empty, see wait_policy.hpp.
+// Overrun decides what a lapped consumer does, the check is out of line so
+// the fast path is the same for every policy.
+// Read selects the payload copy, define SPMC_PORTABLE_SEQLOCK to default to Atomic.
+// Versions selects between slots with embedded versions and a separate version array.
+// Storage selects a heap ring or one embedded in the queue for shared memory,
+// see queue_storage.hpp. Consumers only refer to the queue, so each process
+// keeps its own cursors and makes its consumers from its own mapping.
+template<
+    QueueMsg T,
+    uint64_t Capacity = spmc_default_capacity<T>,
+    typename Wait = SpinWait,
+    OverrunPolicy Overrun = OverrunPolicy::Abort,
+    SeqlockRead Read = default_seqlock_read,
+    VersionLayout Versions = VersionLayout::InSlot,
+    typename Storage = HeapStorage
+>
 class SPMCQueue {
 public:
+    using value_type = T;
+
     SPMCQueue() {};
+    explicit SPMCQueue(const RingAllocOptions& options)
+        requires std::is_same_v<Storage, HeapStorage>
+    : buffer{options}
+    {}
+    // the pages the ring got, RingPages::Huge falls back to TransparentHuge
+    RingPages ring_pages() const
+        requires std::is_same_v<Storage, HeapStorage>
+    {
+        if constexpr (Versions == VersionLayout::InSlot) {
+            return buffer.slots.pages();
+        } else {
+            return std::min(buffer.versions.pages(), buffer.payloads.pages());
+        }
+    }
     SPMCQueue(const SPMCQueue&) = delete;
     SPMCQueue(SPMCQueue&&) = delete;
 
@@ -33,16 +114,40 @@ public:
     SPMCQueue& operator=(SPMCQueue&&) = delete;
 
     using VersionT = uint64_t;
+    // the atomic read path needs the payload as whole words for std::atomic_ref
+    struct Words {
+        uint64_t w[(sizeof(T) + sizeof(uint64_t) - 1) / sizeof(uint64_t)];
+    };
+    // the racy path copies T's bytes as they are, so slots never construct a T
+    struct Bytes {
+        alignas(T) std::byte b[sizeof(T)];
+    };
+    using Payload = std::conditional_t<Read == SeqlockRead::Atomic, Words, Bytes>;
+
     struct alignas(64) Slot {
         std::atomic<VersionT> version{0};
-        T data;
+        Payload data;
+    };
+
+    constexpr static size_t versions_per_line = 64 / sizeof(VersionT);
+    struct alignas(64) VersionLine {
+        std::atomic<VersionT> version[versions_per_line]{};
     };
 
     // alignas on this class is mandatory otherwise it causes
     // hard to debug false sharing
     class alignas(64) Consumer {
         public:
-            bool pop(T& dst);
+            PopResult pop(T& dst);
+            // blocks according to the Wait policy until a message is available
+            void wait_pop(T& dst);
+            // pops up to dst.size() messages, returns how many were popped,
+            // stops early at an overrun
+            size_t pop_bulk(std::span<T> dst);
+            // total messages skipped because of overruns
+            uint64_t lost_messages() const {
+                return lost;
+            }
 
             Consumer(const Consumer&) = delete;
             Consumer(Consumer&&) = default;
@@ -51,69 +156,263 @@ public:
             Consumer& operator=(Consumer&&) = default;
 
         private:
+            [[gnu::noinline, gnu::cold]] PopResult overrun();
+
             friend class SPMCQueue;
             explicit Consumer(SPMCQueue& q)
-            : queue{q},
-              reader{q.writer.load(std::memory_order_acquire)}
+            : reader{q.writer.load(std::memory_order_acquire)},
+              queue{q}
             {}
 
             alignas(64) uint64_t reader;
+            uint64_t lost{0};
             SPMCQueue& queue;
     };
 
     void push(const T&);
+    // writes the whole run and publishes writer once, vals must not exceed the ring size
+    void push_bulk(std::span<const T> vals);
     Consumer make_consumer() {
         return Consumer{*this};
     }
 
 private:
-    // number of slots that fit in 8MB
-    constexpr static uint64_t buffer_size {8 * 1024 * 1024 / sizeof(Slot)};
+    static void store_payload(Payload& dst, const T& val);
+    // copies sizeof(T) bytes, dst need not hold a T yet
+    static void load_payload(Payload& src, void* dst);
+
+    std::atomic<VersionT>& version_at(uint64_t idx);
+    Payload& payload_at(uint64_t idx);
+
+    // The atomic path orders the payload with release stores and acquire
+    // loads on every word instead of relaxed accesses plus fences: on x86
+    // both are plain movs, and TSAN models them but not standalone fences.
+    // A payload word written by a newer push makes the odd version visible
+    // to the second version load, so torn copies are always caught.
+    constexpr static auto first_version_order =
+        Read == SeqlockRead::Atomic ? std::memory_order_acquire : std::memory_order_relaxed;
+    constexpr static auto second_version_order =
+        Read == SeqlockRead::Atomic ? std::memory_order_relaxed : std::memory_order_acquire;
+
+    constexpr static uint64_t buffer_size {std::bit_ceil(Capacity)};
     constexpr static uint64_t wrap_mask {buffer_size - 1};
 
+    struct SlotStorage {
+        SlotStorage() = default;
+        explicit SlotStorage(const RingAllocOptions& options)
+        : slots{options}
+        {}
+
+        typename Storage::template Array<Slot, buffer_size> slots;
+    };
+
+    struct SeparateStorage {
+        SeparateStorage() = default;
+        explicit SeparateStorage(const RingAllocOptions& options)
+        : versions{options},
+          payloads{options}
+        {}
+
+        typename Storage::template Array<VersionLine, buffer_size / versions_per_line> versions;
+        // cache line aligned so small payloads pack evenly into lines
+        typename Storage::template Array<Payload, buffer_size> payloads;
+    };
+
     alignas(64) std::atomic<uint64_t> writer{0};
-    std::unique_ptr<Slot[]> buffer = std::make_unique<Slot[]>(buffer_size);
+    std::conditional_t<Versions == VersionLayout::InSlot, SlotStorage, SeparateStorage> buffer;
+    [[no_unique_address]] Wait wait;
 
     static_assert(std::popcount(buffer_size) == 1);
+    static_assert(Versions == VersionLayout::InSlot || buffer_size >= versions_per_line);
 };
 
-template<QueueMsg T>
-inline void SPMCQueue<T>::push(const T& val) {
+template<QueueMsg T, uint64_t Capacity, typename Wait, OverrunPolicy Overrun, SeqlockRead Read, VersionLayout Versions, typename Storage>
+inline auto SPMCQueue<T, Capacity, Wait, Overrun, Read, Versions, Storage>::version_at(uint64_t idx) -> std::atomic<VersionT>& {
+    uint64_t i = idx & wrap_mask;
+    if constexpr (Versions == VersionLayout::InSlot) {
+        return buffer.slots[i].version;
+    } else {
+        return buffer.versions[i / versions_per_line].version[i % versions_per_line];
+    }
+}
+
+template<QueueMsg T, uint64_t Capacity, typename Wait, OverrunPolicy Overrun, SeqlockRead Read, VersionLayout Versions, typename Storage>
+inline auto SPMCQueue<T, Capacity, Wait, Overrun, Read, Versions, Storage>::payload_at(uint64_t idx) -> Payload& {
+    uint64_t i = idx & wrap_mask;
+    if constexpr (Versions == VersionLayout::InSlot) {
+        return buffer.slots[i].data;
+    } else {
+        return buffer.payloads[i];
+    }
+}
+
+template<QueueMsg T, uint64_t Capacity, typename Wait, OverrunPolicy Overrun, SeqlockRead Read, VersionLayout Versions, typename Storage>
+inline void SPMCQueue<T, Capacity, Wait, Overrun, Read, Versions, Storage>::store_payload(Payload& dst, const T& val) {
+    if constexpr (Read == SeqlockRead::Atomic) {
+        Words words{};
+        std::memcpy(words.w, &val, sizeof(T));
+        for (size_t i = 0; i < std::size(words.w); ++i) {
+            std::atomic_ref<uint64_t>(dst.w[i]).store(words.w[i], std::memory_order_release);
+        }
+    } else {
+        std::memcpy(dst.b, &val, sizeof(T));
+    }
+}
+
+template<QueueMsg T, uint64_t Capacity, typename Wait, OverrunPolicy Overrun, SeqlockRead Read, VersionLayout Versions, typename Storage>
+inline void SPMCQueue<T, Capacity, Wait, Overrun, Read, Versions, Storage>::load_payload(Payload& src, void* dst) {
+    if constexpr (Read == SeqlockRead::Atomic) {
+        Words words;
+        for (size_t i = 0; i < std::size(words.w); ++i) {
+            words.w[i] = std::atomic_ref<uint64_t>(src.w[i]).load(std::memory_order_acquire);
+        }
+        std::memcpy(dst, words.w, sizeof(T));
+    } else {
+        std::memcpy(dst, src.b, sizeof(T));
+    }
+}
+
+template<QueueMsg T, uint64_t Capacity, typename Wait, OverrunPolicy Overrun, SeqlockRead Read, VersionLayout Versions, typename Storage>
+inline void SPMCQueue<T, Capacity, Wait, Overrun, Read, Versions, Storage>::push(const T& val) {
     uint64_t w = writer.load(std::memory_order_relaxed);
-    auto& slot = buffer[w & wrap_mask];
-    auto slot_ver = slot.version.load(std::memory_order_acquire);
+    auto& version = version_at(w);
+    auto slot_ver = version.load(std::memory_order_acquire);
 
-    slot.version.store(slot_ver + 1, std::memory_order_relaxed);
-    slot.data = val;
-    slot.version.store(slot_ver + 2, std::memory_order_release);
+    version.store(slot_ver + 1, std::memory_order_relaxed);
+    store_payload(payload_at(w), val);
+    version.store(slot_ver + 2, std::memory_order_release);
 
     writer.store(w + 1, std::memory_order_release);
+    wait.notify();
 }
 
-template<QueueMsg T>
-inline bool SPMCQueue<T>::Consumer::pop(T& dst) {
-    uint64_t r_idx = (reader & wrap_mask);
+template<QueueMsg T, uint64_t Capacity, typename Wait, OverrunPolicy Overrun, SeqlockRead Read, VersionLayout Versions, typename Storage>
+inline void SPMCQueue<T, Capacity, Wait, Overrun, Read, Versions, Storage>::push_bulk(std::span<const T> vals) {
+    uint64_t w = writer.load(std::memory_order_relaxed);
+
+    for (size_t i = 0; i < vals.size(); ++i) {
+        auto& version = version_at(w + i);
+        // every slot is written once per generation, so its version
+        // follows from the index and doesn't need to be loaded
+        VersionT slot_ver = 2 * ((w + i) >> std::countr_zero(buffer_size));
+
+        version.store(slot_ver + 1, std::memory_order_relaxed);
+        store_payload(payload_at(w + i), vals[i]);
+        version.store(slot_ver + 2, std::memory_order_release);
+    }
+
+    writer.store(w + vals.size(), std::memory_order_release);
+    wait.notify();
+}
+
+template<QueueMsg T, uint64_t Capacity, typename Wait, OverrunPolicy Overrun, SeqlockRead Read, VersionLayout Versions, typename Storage>
+inline PopResult SPMCQueue<T, Capacity, Wait, Overrun, Read, Versions, Storage>::Consumer::pop(T& dst) {
     uint64_t gen = reader >> std::countr_zero(buffer_size);
 
     uint64_t expected_version = 2 * (gen + 1);
 
-    auto& slot = queue.buffer[r_idx];
-    auto v1 = slot.version.load(std::memory_order_relaxed);
+    auto& version = queue.version_at(reader);
+    auto v1 = version.load(first_version_order);
 
-    UNEXPECTED(v1 > expected_version);
+    if (v1 > expected_version) [[unlikely]] {
+        return overrun();
+    }
     if (v1 < expected_version) {
-        return false;
+        return {PopResult::Status::Empty, 0};
     }
 
-    // this is UB, because it is a data-race by the C++ standard
+    // with SeqlockRead::Racy this is UB, because it is a data-race by the C++ standard
     // this is deliberate and it is not portable, but it does work on x86
-    T temp = queue.buffer[r_idx].data;
+    // raw bytes, so T needs no default constructor
+    alignas(T) std::byte temp[sizeof(T)];
+    load_payload(queue.payload_at(reader), temp);
 
-    auto v2 = slot.version.load(std::memory_order_acquire);
-    UNEXPECTED(v2 != expected_version);
+    auto v2 = version.load(second_version_order);
+    if (v2 != expected_version) [[unlikely]] {
+        return overrun();
+    }
 
-    dst = temp;
+    std::memcpy(&dst, temp, sizeof(T));
     reader++;
 
-    return true;
+    return {PopResult::Status::Ok, 0};
+}
+
+template<QueueMsg T, uint64_t Capacity, typename Wait, OverrunPolicy Overrun, SeqlockRead Read, VersionLayout Versions, typename Storage>
+inline void SPMCQueue<T, Capacity, Wait, Overrun, Read, Versions, Storage>::Consumer::wait_pop(T& dst) {
+    // the producer writes the version of the slot we are waiting on
+    const void* watch = &queue.version_at(reader);
+    queue.wait.wait(watch, [&] { return pop(dst).status == PopResult::Status::Ok; });
+}
+
+template<QueueMsg T, uint64_t Capacity, typename Wait, OverrunPolicy Overrun, SeqlockRead Read, VersionLayout Versions, typename Storage>
+inline size_t SPMCQueue<T, Capacity, Wait, Overrun, Read, Versions, Storage>::Consumer::pop_bulk(std::span<T> dst) {
+    constexpr uint64_t gen_shift = std::countr_zero(buffer_size);
+
+    // find the run of published slots first, then copy it and validate
+    // it as a whole so the version checks don't serialise the copies
+    size_t n = 0;
+    for (; n < dst.size(); ++n) {
+        uint64_t r = reader + n;
+        uint64_t expected_version = 2 * ((r >> gen_shift) + 1);
+        auto v1 = queue.version_at(r).load(first_version_order);
+
+        if (v1 > expected_version) [[unlikely]] {
+            if (n == 0) {
+                overrun();
+                return 0;
+            }
+            // hand out what is still valid, the next call reports the overrun
+            break;
+        }
+        if (v1 < expected_version) {
+            break;
+        }
+    }
+
+    // same deliberate data race as in pop with SeqlockRead::Racy
+    for (size_t i = 0; i < n; ++i) {
+        load_payload(queue.payload_at(reader + i), &dst[i]);
+    }
+
+    for (size_t i = 0; i < n; ++i) {
+        uint64_t r = reader + i;
+        uint64_t expected_version = 2 * ((r >> gen_shift) + 1);
+        auto v2 = queue.version_at(r).load(second_version_order);
+        if (v2 != expected_version) [[unlikely]] {
+            // everything before i was validated
+            reader += i;
+            overrun();
+            return i;
+        }
+    }
+
+    reader += n;
+    return n;
+}
+
+template<QueueMsg T, uint64_t Capacity, typename Wait, OverrunPolicy Overrun, SeqlockRead Read, VersionLayout Versions, typename Storage>
+PopResult SPMCQueue<T, Capacity, Wait, Overrun, Read, Versions, Storage>::Consumer::overrun() {
+    if constexpr (Overrun == OverrunPolicy::Abort) {
+        unexpected_abort();
+    }
+
+    uint64_t w = queue.writer.load(std::memory_order_acquire);
+    uint64_t next_reader;
+    if constexpr (Overrun == OverrunPolicy::Resync) {
+        // slot w & wrap_mask is the next one the producer overwrites
+        next_reader = w - buffer_size + 1;
+    } else {
+        next_reader = w - 1;
+    }
+
+    // push_bulk publishes writer after the whole run, so it can trail the
+    // slot that lapped us; always skip at least the lost message
+    next_reader = std::max(next_reader, reader + 1);
+
+    uint64_t skipped = next_reader - reader;
+    reader = next_reader;
+    lost += skipped;
+
+    return {PopResult::Status::Overrun, skipped};
 }
@@ -0,0 +1,162 @@
+#pragma once
+
+#include <atomic>
+#include <algorithm>
+#include <bit>
+#include <cstdint>
+#include <span>
+#include <type_traits>
+#include "queue_concepts.hpp"
+#include "queue_storage.hpp"
+#include "wait_policy.hpp"
+
+template<typename T>
+constexpr uint64_t spmc_work_default_capacity = ring_slots_in_8mb<sizeof(std::atomic<uint64_t>) + sizeof(T)>;
+
+// Single producer, work-distributing consumers: every message goes to
+// exactly one consumer, unlike SPMCQueue which fans out to all of them.
+//
+// The producer publishes with a release store of tail. Consumers take
+// tickets by CAS on head, one or a whole run at a time, copy the claimed
+// slots and hand each one back to the producer through its sequence
+// (index + ring size, i.e. free for the next lap). The producer never
+// overwrites a slot that has not been handed back, so no message is lost.
+//
+// Capacity is the ring size in slots, rounded up to a power of two.
+// Wait is the policy wait_pop uses while the queue is empty, see wait_policy.hpp.
+// Storage selects a heap ring or one embedded in the queue for shared memory,
+// see queue_storage.hpp.
+template<
+    QueueMsg T,
+    uint64_t Capacity = spmc_work_default_capacity<T>,
+    typename Wait = SpinWait,
+    typename Storage = HeapStorage
+>
+class SPMCWorkQueue {
+public:
+    using value_type = T;
+
+    SPMCWorkQueue() {
+        init_sequences();
+    }
+
+    explicit SPMCWorkQueue(const RingAllocOptions& options)
+        requires std::is_same_v<Storage, HeapStorage>
+    : slots{options}
+    {
+        init_sequences();
+    }
+
+    SPMCWorkQueue(const SPMCWorkQueue&) = delete;
+    SPMCWorkQueue(SPMCWorkQueue&&) = delete;
+
+    SPMCWorkQueue& operator=(const SPMCWorkQueue&) = delete;
+    SPMCWorkQueue& operator=(SPMCWorkQueue&&) = delete;
+
+    // producer thread only, false when the oldest slot was not consumed yet
+    bool try_push(const T& val);
+    // producer thread only, pushes as many as fit and publishes tail once
+    size_t try_push_burst(std::span<const T> vals);
+
+    // any consumer thread
+    bool try_pop(T& dst);
+    // blocks according to the Wait policy until a message is available
+    void wait_pop(T& dst);
+    // claims up to dst.size() messages with a single CAS, returns how many
+    size_t pop_bulk(std::span<T> dst);
+
+private:
+    struct alignas(64) Slot {
+        // i: free for the push at index i, written by the consumer that took i - buffer_size
+        std::atomic<uint64_t> sequence;
+        T data;
+    };
+
+    void init_sequences() {
+        for (uint64_t i = 0; i < buffer_size; ++i) {
+            slots[i].sequence.store(i, std::memory_order_relaxed);
+        }
+    }
+
+    constexpr static uint64_t buffer_size {std::bit_ceil(Capacity)};
+    constexpr static uint64_t wrap_mask {buffer_size - 1};
+
+    typename Storage::template Array<Slot, buffer_size> slots;
+
+    // contended by the consumers
+    alignas(64) std::atomic<uint64_t> head{0};
+    // written by the producer only
+    alignas(64) std::atomic<uint64_t> tail{0};
+    [[no_unique_address]] Wait wait;
+
+    static_assert(std::popcount(buffer_size) == 1);
+};
+
+template<QueueMsg T, uint64_t Capacity, typename Wait, typename Storage>
+inline bool SPMCWorkQueue<T, Capacity, Wait, Storage>::try_push(const T& val) {
+    uint64_t t = tail.load(std::memory_order_relaxed);
+    Slot& slot = slots[t & wrap_mask];
+    if (slot.sequence.load(std::memory_order_acquire) != t) {
+        return false;
+    }
+
+    slot.data = val;
+
+    tail.store(t + 1, std::memory_order_release);
+    wait.notify();
+    return true;
+}
+
+template<QueueMsg T, uint64_t Capacity, typename Wait, typename Storage>
+inline size_t SPMCWorkQueue<T, Capacity, Wait, Storage>::try_push_burst(std::span<const T> vals) {
+    uint64_t t = tail.load(std::memory_order_relaxed);
+
+    size_t n = 0;
+    for (; n < vals.size(); ++n) {
+        Slot& slot = slots[(t + n) & wrap_mask];
+        if (slot.sequence.load(std::memory_order_acquire) != t + n) {
+            break;
+        }
+        slot.data = vals[n];
+    }
+
+    if (n > 0) {
+        tail.store(t + n, std::memory_order_release);
+        wait.notify();
+    }
+    return n;
+}
+
+template<QueueMsg T, uint64_t Capacity, typename Wait, typename Storage>
+inline bool SPMCWorkQueue<T, Capacity, Wait, Storage>::try_pop(T& dst) {
+    return pop_bulk(std::span<T>(&dst, 1)) == 1;
+}
+
+template<QueueMsg T, uint64_t Capacity, typename Wait, typename Storage>
+inline void SPMCWorkQueue<T, Capacity, Wait, Storage>::wait_pop(T& dst) {
+    // the producer writes tail on every publish
+    wait.wait(&tail, [&] { return try_pop(dst); });
+}
+
+template<QueueMsg T, uint64_t Capacity, typename Wait, typename Storage>
+inline size_t SPMCWorkQueue<T, Capacity, Wait, Storage>::pop_bulk(std::span<T> dst) {
+    uint64_t h = head.load(std::memory_order_relaxed);
+    size_t n;
+    do {
+        uint64_t t = tail.load(std::memory_order_acquire);
+        // head is relaxed, so tail can look older than the head another consumer moved to
+        if (t <= h) {
+            return 0;
+        }
+        n = std::min<uint64_t>(dst.size(), t - h);
+        // on failure h is reloaded with the current head
+    } while (!head.compare_exchange_weak(h, h + n, std::memory_order_relaxed));
+
+    // the run [h, h + n) is ours, the producer can't reuse it before we hand it back
+    for (size_t i = 0; i < n; ++i) {
+        Slot& slot = slots[(h + i) & wrap_mask];
+        dst[i] = slot.data;
+        slot.sequence.store(h + i + buffer_size, std::memory_order_release);
+    }
+    return n;
+}
@@ -1,11 +1,25 @@
 #pragma once
 #include <span>
+#include <algorithm>
 #include <memory>
 #include <atomic>
+#include <cstdint>
+#include "buffer_views.hpp"
+#include "mirrored_mapping.hpp"
+#include "ring_memory.hpp"
 
 class SPSCBuffer {
 public:
-    SPSCBuffer() {};
+    static constexpr size_t defaultCapacity_ = 8 * 1024 * 1024;
+
+    // capacity in bytes, rounded up to a power of two (and to a page when mirrored).
+    // A mirrored buffer never splits a copy or a view at the end of the ring.
+    // A mirrored ring is a memfd with small pages, options.pages only applies to Single
+    explicit SPSCBuffer(
+        size_t capacity = defaultCapacity_,
+        RingMapping mapping = RingMapping::Single,
+        const RingAllocOptions& options = {}
+    );
 
     SPSCBuffer(const SPSCBuffer& q) = delete;
     SPSCBuffer(SPSCBuffer&& q) = delete;
@@ -16,10 +30,57 @@ public:
     size_t read(std::span<std::byte> dst);
     bool try_write(std::span<const std::byte> data);
     size_t available(size_t writer, size_t reader) const;
+    size_t capacity() const { return bufferSize_; }
+
+    // Zero-copy reads: peek() returns everything readable, consume(n)
+    // releases the first n bytes of it. Views of a mirrored buffer only use first.
+    ReadView peek() const;
+    void consume(size_t n);
+    // Zero-copy writes: reserve(n) returns exactly n writable bytes or an
+    // empty view if they are not free, commit(n) publishes the first n of them.
+    WriteView reserve(size_t n);
+    void commit(size_t n);
+
+    // Message mode: every record is a length header followed by the payload,
+    // padded to 8 bytes. A record never straddles the end of the ring, the
+    // writer leaves a pad marker instead and starts over at offset 0
+    // (unless the buffer is mirrored, then records just run into the mirror).
+    // Don't mix message and byte calls on the same buffer.
+
+    // writes the whole message or nothing. Throws std::invalid_argument for
+    // empty messages and messages larger than max_msg_size()
+    bool try_write_msg(std::span<const std::byte> msg);
+    // copies the next message into dst and returns its size, 0 if none is queued.
+    // A message larger than dst stays queued and std::length_error is thrown
+    size_t read_msg(std::span<std::byte> dst);
+    // the next message in place, empty if none is queued. Stays valid until
+    // consume_msg(), which must only follow a non-empty peek_msg()
+    std::span<const std::byte> peek_msg();
+    void consume_msg();
+    // half the ring, so a record always fits once the reader caught up, wherever the writer is.
+    // A mirrored ring only keeps the last 8 bytes free
+    size_t max_msg_size() const {
+        if (bufferSize_ < 2 * msgAlign_) {
+            return 0;
+        }
+        size_t recordLimit = mirrored_ ? bufferSize_ - msgAlign_ : bufferSize_ / 2;
+        return std::min<size_t>(recordLimit - sizeof(MsgHeader), padMarker_ - 1);
+    }
 
 private:
-    static constexpr size_t bufferSize_ = 8 * 1024 * 1024;
-    std::unique_ptr<std::byte[]> buffer_ = std::make_unique<std::byte[]>(bufferSize_);
+    using MsgHeader = uint32_t;
+    static constexpr MsgHeader padMarker_ = 0xFFFFFFFF;
+    static constexpr size_t msgAlign_ = 8;
+
+    static size_t record_size(size_t msgSize) {
+        return (sizeof(MsgHeader) + msgSize + msgAlign_ - 1) & ~(msgAlign_ - 1);
+    }
+
+    const size_t bufferSize_;
+    const bool mirrored_;
+    std::unique_ptr<RingMemory> memory_;
+    std::unique_ptr<MirroredMapping> mirror_;
+    std::byte* const buffer_;
     alignas(64) std::atomic<size_t> reader_ = 0;
     alignas(64) std::atomic<size_t> writer_ = 0;
 };
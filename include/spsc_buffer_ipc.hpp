@@ -1,15 +1,18 @@
 #pragma once
 #include <span>
 #include <atomic>
-
-struct ReadView {
-    std::span<const std::byte> first;
-    std::span<const std::byte> second;
-};
+#include <cstddef>
+#include <cstdint>
+#include "buffer_views.hpp"
+#include "mirrored_mapping.hpp"
 
 class IPCSPSCBuffer {
 public:
-    IPCSPSCBuffer() {};
+    // Mirrored: the caller mapped the ring twice, e.g. in every process with
+    // MirroredMapping(fd, ring_offset(), ring_size()) over a file of sizeof(IPCSPSCBuffer) bytes
+    explicit IPCSPSCBuffer(RingMapping mapping = RingMapping::Single)
+    : mirrored_{mapping == RingMapping::Mirrored}
+    {}
 
     IPCSPSCBuffer(const IPCSPSCBuffer& q) = delete;
     IPCSPSCBuffer(IPCSPSCBuffer&& q) = delete;
@@ -21,9 +24,24 @@ public:
     bool try_write(std::span<const std::byte> data);
     size_t available(size_t writer, size_t reader) const;
 
+    // where the ring sits in the object, both are page multiples
+    static size_t ring_offset() { return offsetof(IPCSPSCBuffer, buffer_); }
+    static constexpr size_t ring_size() { return bufferSize_; }
+
+    // Zero-copy reads: peek() returns everything readable, consume(n)
+    // releases the first n bytes of it. Views of a mirrored buffer only use first.
+    ReadView peek() const;
+    void consume(size_t n);
+    // Zero-copy writes: reserve(n) returns exactly n writable bytes or an
+    // empty view if they are not free, commit(n) publishes the first n of them.
+    WriteView reserve(size_t n);
+    void commit(size_t n);
+
 private:
     static constexpr size_t bufferSize_ = 8 * 1024 * 1024;
-    alignas(64) std::byte buffer_[bufferSize_];
     alignas(64) std::atomic<uint64_t> reader_ = 0;
     alignas(64) std::atomic<uint64_t> writer_ = 0;
+    const bool mirrored_;
+    // last and page aligned, so the mirror can be mapped right behind the object
+    alignas(4096) std::byte buffer_[bufferSize_];
 };
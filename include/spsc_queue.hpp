@@ -4,16 +4,53 @@
 #include <atomic>
 #include <assert.h>
 #include <cstring>
+#include <span>
+#include <algorithm>
+#include <bit>
+#include "queue_storage.hpp"
+#include "wait_policy.hpp"
 
 static constexpr size_t slotSize_ = 64;
-struct Slot {
-    alignas(64) std::byte storage[64];
-};
+
+// size of T rounded up to whole cache lines
+template<typename T>
+static constexpr size_t cacheLineSlotSize_ = (sizeof(T) + slotSize_ - 1) / slotSize_ * slotSize_;
 
 template<typename T>
+static constexpr size_t defaultCapacity_ = ring_slots_in_8mb<sizeof(T)>;
+
+enum class SlotLayout {
+    // every element owns one or more whole cache lines, no two elements share a line
+    CacheLine,
+    // elements are stored back to back, several small elements share a line
+    Packed,
+};
+
+// Capacity is the ring size in slots, rounded up to a power of two.
+// One slot is kept empty, so at most Capacity - 1 elements are queued.
+// CacheRemoteIndex keeps a local copy of the other side's index so the
+// shared index line is only touched when the queue looks full/empty.
+// Disabling it is only useful for benchmarking against the old behaviour.
+// Wait is the policy wait_pop uses while the queue is empty, see wait_policy.hpp.
+// Storage selects a heap ring or one embedded in the queue for shared memory,
+// see queue_storage.hpp.
+template<
+    typename T,
+    size_t Capacity = defaultCapacity_<T>,
+    SlotLayout Layout = SlotLayout::CacheLine,
+    typename Wait = SpinWait,
+    bool CacheRemoteIndex = true,
+    typename Storage = HeapStorage
+>
 class SPSCQueue {
 public:
+    using value_type = T;
+
     SPSCQueue() {};
+    explicit SPSCQueue(const RingAllocOptions& options)
+        requires std::is_same_v<Storage, HeapStorage>
+    : buffer_{options}
+    {}
 
     SPSCQueue(const SPSCQueue& q) = delete;
     SPSCQueue(SPSCQueue&& q) = delete;
@@ -22,50 +59,121 @@ public:
     SPSCQueue& operator=(SPSCQueue&& q) = delete;
 
     bool try_pop(T& dst);
+    // blocks according to the Wait policy until an element is available
+    void wait_pop(T& dst);
     bool try_push(const T& data);
     bool try_push(T&& data);
     size_t used(size_t writer, size_t reader) const;
 
+    // bulk: all-or-nothing, burst: as many as fit/are available.
+    // Both publish the index once per call.
+    bool try_push_bulk(std::span<const T> data);
+    size_t try_push_burst(std::span<const T> data);
+    bool try_pop_bulk(std::span<T> dst);
+    size_t try_pop_burst(std::span<T> dst);
+
+    // Zero-copy producer: try_reserve hands out the next free slot (nullptr
+    // when full) for the caller to fill in place, commit publishes it.
+    // Calling try_reserve again before commit returns the same slot.
+    // Types that need construction go through try_emplace instead.
+    T* try_reserve()
+        requires std::is_trivially_default_constructible_v<T> && std::is_trivially_destructible_v<T>;
+    void commit();
+    template<typename... Args>
+    bool try_emplace(Args&&... args);
+
+    // Zero-copy consumer: front returns the oldest element in place
+    // (nullptr when empty), pop_front destroys it and releases the slot.
+    const T* front();
+    void pop_front();
+
+    // trivial for trivial T, so an embedded queue can stay in shared memory
+    ~SPSCQueue() requires std::is_trivially_destructible_v<T> = default;
     ~SPSCQueue() {
-        if constexpr (!std::is_trivially_destructible_v<T>) {
-            size_t reader = reader_.load(std::memory_order_relaxed);
-            size_t writer = writer_.load(std::memory_order_relaxed);
-            while (reader != writer) {
-                Slot& s = buffer_[reader & wrapMask_];
-                T* ptr = std::launder(reinterpret_cast<T*>(s.storage));
-                ptr->~T();
-                ++reader;
-            }
+        size_t reader = reader_.load(std::memory_order_relaxed);
+        size_t writer = writer_.load(std::memory_order_relaxed);
+        while (reader != writer) {
+            Slot& s = buffer_[reader & wrapMask_];
+            T* ptr = std::launder(reinterpret_cast<T*>(s.storage));
+            ptr->~T();
+            ++reader;
         }
     }
 
 private:
-    static constexpr size_t bufferSizeBytes_ = 8 * 1024 * 1024;
-    static constexpr size_t bufferSizeSlots_ = bufferSizeBytes_ / 64;
+    static constexpr bool packed_ = Layout == SlotLayout::Packed;
+    struct Slot {
+        alignas(packed_ ? alignof(T) : std::max(slotSize_, alignof(T)))
+        std::byte storage[packed_ ? sizeof(T) : cacheLineSlotSize_<T>];
+    };
+
+    size_t free_slots(size_t writer, size_t wanted);
+    size_t readable_slots(size_t reader, size_t wanted);
+    void write_run(size_t writer, std::span<const T> data);
+    void read_run(size_t reader, std::span<T> dst);
+
+    static_assert(Capacity >= 2);
+    static constexpr size_t bufferSizeSlots_ = std::bit_ceil(Capacity);
     static constexpr size_t wrapMask_ = bufferSizeSlots_ - 1;
-    std::unique_ptr<Slot[]> buffer_ = std::make_unique<Slot[]>(bufferSizeSlots_);
+    typename Storage::template Array<Slot, bufferSizeSlots_> buffer_;
     static_assert((bufferSizeSlots_ & (bufferSizeSlots_ - 1)) == 0);
 
     alignas(64) std::atomic<size_t> reader_ = 0;
+    // consumer-local, refreshed from writer_ only when the queue looks empty
+    alignas(64) size_t writerCache_ = 0;
+
     alignas(64) std::atomic<size_t> writer_ = 0;
+    // producer-local, refreshed from reader_ only when the queue looks full
+    alignas(64) size_t readerCache_ = 0;
+
+    [[no_unique_address]] Wait wait_;
 };
 
-template<typename T>
-size_t SPSCQueue<T>::used(size_t writer, size_t reader) const {
+template<typename T, size_t Capacity, SlotLayout Layout, typename Wait, bool CacheRemoteIndex, typename Storage>
+size_t SPSCQueue<T, Capacity, Layout, Wait, CacheRemoteIndex, Storage>::used(size_t writer, size_t reader) const {
     return writer - reader;
 }
 
-template<typename T>
-bool SPSCQueue<T>::try_push(const T& data) {
-    static_assert(sizeof(T) <= 64);
+// free slots, refreshing the cached reader index only if fewer than `wanted` look free
+template<typename T, size_t Capacity, SlotLayout Layout, typename Wait, bool CacheRemoteIndex, typename Storage>
+size_t SPSCQueue<T, Capacity, Layout, Wait, CacheRemoteIndex, Storage>::free_slots(size_t writer, size_t wanted) {
+    if constexpr (CacheRemoteIndex) {
+        size_t freeSpace = bufferSizeSlots_ - 1 - used(writer, readerCache_);
+        if (freeSpace >= wanted) {
+            return freeSpace;
+        }
+
+        readerCache_ = reader_.load(std::memory_order_acquire);
+        return bufferSizeSlots_ - 1 - used(writer, readerCache_);
+    } else {
+        size_t reader = reader_.load(std::memory_order_acquire);
+        return bufferSizeSlots_ - 1 - used(writer, reader);
+    }
+}
+
+// readable slots, refreshing the cached writer index only if fewer than `wanted` look readable
+template<typename T, size_t Capacity, SlotLayout Layout, typename Wait, bool CacheRemoteIndex, typename Storage>
+size_t SPSCQueue<T, Capacity, Layout, Wait, CacheRemoteIndex, Storage>::readable_slots(size_t reader, size_t wanted) {
+    if constexpr (CacheRemoteIndex) {
+        size_t avail = used(writerCache_, reader);
+        if (avail >= wanted) {
+            return avail;
+        }
+
+        writerCache_ = writer_.load(std::memory_order_acquire);
+        return used(writerCache_, reader);
+    } else {
+        return used(writer_.load(std::memory_order_acquire), reader);
+    }
+}
+
+template<typename T, size_t Capacity, SlotLayout Layout, typename Wait, bool CacheRemoteIndex, typename Storage>
+bool SPSCQueue<T, Capacity, Layout, Wait, CacheRemoteIndex, Storage>::try_push(const T& data) {
+    static_assert(sizeof(T) <= sizeof(Slot));
     static_assert(alignof(T) <= alignof(Slot));
 
     size_t writer = writer_.load(std::memory_order_relaxed);
-    size_t reader = reader_.load(std::memory_order_acquire);
-
-    size_t avail = used(writer, reader);
-    size_t freeSpace = bufferSizeSlots_ - 1 - avail;
-    if (freeSpace < 1) {
+    if (free_slots(writer, 1) < 1) {
         return false;
     }
 
@@ -77,20 +185,17 @@ bool SPSCQueue<T>::try_push(const T& data) {
     }
 
     writer_.store(writer + 1, std::memory_order_release);
+    wait_.notify();
     return true;
 }
 
-template<typename T>
-bool SPSCQueue<T>::try_push(T&& data) {
-    static_assert(sizeof(T) <= 64);
+template<typename T, size_t Capacity, SlotLayout Layout, typename Wait, bool CacheRemoteIndex, typename Storage>
+bool SPSCQueue<T, Capacity, Layout, Wait, CacheRemoteIndex, Storage>::try_push(T&& data) {
+    static_assert(sizeof(T) <= sizeof(Slot));
     static_assert(alignof(T) <= alignof(Slot));
 
     size_t writer = writer_.load(std::memory_order_relaxed);
-    size_t reader = reader_.load(std::memory_order_acquire);
-
-    size_t avail = used(writer, reader);
-    size_t freeSpace = bufferSizeSlots_ - 1 - avail;
-    if (freeSpace < 1) {
+    if (free_slots(writer, 1) < 1) {
         return false;
     }
 
@@ -102,18 +207,17 @@ bool SPSCQueue<T>::try_push(T&& data) {
     }
 
     writer_.store(writer + 1, std::memory_order_release);
+    wait_.notify();
     return true;
 }
 
-template<typename T>
-bool SPSCQueue<T>::try_pop(T& dst) {
-    static_assert(sizeof(T) <= 64);
+template<typename T, size_t Capacity, SlotLayout Layout, typename Wait, bool CacheRemoteIndex, typename Storage>
+bool SPSCQueue<T, Capacity, Layout, Wait, CacheRemoteIndex, Storage>::try_pop(T& dst) {
+    static_assert(sizeof(T) <= sizeof(Slot));
     static_assert(alignof(T) <= alignof(Slot));
 
     size_t reader = reader_.load(std::memory_order_relaxed);
-    size_t writer = writer_.load(std::memory_order_acquire);
-
-    if (reader == writer) {
+    if (readable_slots(reader, 1) < 1) {
         return false;
     }
 
@@ -129,3 +233,176 @@ bool SPSCQueue<T>::try_pop(T& dst) {
     reader_.store(reader + 1, std::memory_order_release);
     return true;
 }
+
+template<typename T, size_t Capacity, SlotLayout Layout, typename Wait, bool CacheRemoteIndex, typename Storage>
+void SPSCQueue<T, Capacity, Layout, Wait, CacheRemoteIndex, Storage>::wait_pop(T& dst) {
+    wait_.wait(&writer_, [&] { return try_pop(dst); });
+}
+
+template<typename T, size_t Capacity, SlotLayout Layout, typename Wait, bool CacheRemoteIndex, typename Storage>
+void SPSCQueue<T, Capacity, Layout, Wait, CacheRemoteIndex, Storage>::write_run(size_t writer, std::span<const T> data) {
+    if constexpr (packed_ && std::is_trivially_copyable_v<T>) {
+        // packed slots are contiguous, so the run is at most two copies
+        size_t idx = writer & wrapMask_;
+        size_t first = std::min(data.size(), bufferSizeSlots_ - idx);
+        std::memcpy(buffer_[idx].storage, data.data(), first * sizeof(T));
+        std::memcpy(buffer_[0].storage, data.data() + first, (data.size() - first) * sizeof(T));
+        return;
+    }
+
+    for (size_t i = 0; i < data.size(); ++i) {
+        Slot& s = buffer_[(writer + i) & wrapMask_];
+        if constexpr (std::is_trivially_copyable_v<T>) {
+            std::memcpy(s.storage, &data[i], sizeof(T));
+        } else {
+            new (s.storage) T(data[i]);
+        }
+    }
+}
+
+template<typename T, size_t Capacity, SlotLayout Layout, typename Wait, bool CacheRemoteIndex, typename Storage>
+void SPSCQueue<T, Capacity, Layout, Wait, CacheRemoteIndex, Storage>::read_run(size_t reader, std::span<T> dst) {
+    if constexpr (packed_ && std::is_trivially_copyable_v<T>) {
+        size_t idx = reader & wrapMask_;
+        size_t first = std::min(dst.size(), bufferSizeSlots_ - idx);
+        std::memcpy(dst.data(), buffer_[idx].storage, first * sizeof(T));
+        std::memcpy(dst.data() + first, buffer_[0].storage, (dst.size() - first) * sizeof(T));
+        return;
+    }
+
+    for (size_t i = 0; i < dst.size(); ++i) {
+        Slot& s = buffer_[(reader + i) & wrapMask_];
+        if constexpr (std::is_trivially_copyable_v<T>) {
+            std::memcpy(&dst[i], s.storage, sizeof(T));
+        } else {
+            T* ptr = std::launder(reinterpret_cast<T*>(s.storage));
+            dst[i] = std::move(*ptr);
+            ptr->~T();
+        }
+    }
+}
+
+template<typename T, size_t Capacity, SlotLayout Layout, typename Wait, bool CacheRemoteIndex, typename Storage>
+bool SPSCQueue<T, Capacity, Layout, Wait, CacheRemoteIndex, Storage>::try_push_bulk(std::span<const T> data) {
+    static_assert(sizeof(T) <= sizeof(Slot));
+    static_assert(alignof(T) <= alignof(Slot));
+
+    size_t writer = writer_.load(std::memory_order_relaxed);
+    if (free_slots(writer, data.size()) < data.size()) {
+        return false;
+    }
+
+    write_run(writer, data);
+
+    writer_.store(writer + data.size(), std::memory_order_release);
+    wait_.notify();
+    return true;
+}
+
+template<typename T, size_t Capacity, SlotLayout Layout, typename Wait, bool CacheRemoteIndex, typename Storage>
+size_t SPSCQueue<T, Capacity, Layout, Wait, CacheRemoteIndex, Storage>::try_push_burst(std::span<const T> data) {
+    static_assert(sizeof(T) <= sizeof(Slot));
+    static_assert(alignof(T) <= alignof(Slot));
+
+    size_t writer = writer_.load(std::memory_order_relaxed);
+    size_t n = std::min(data.size(), free_slots(writer, data.size()));
+    if (n == 0) {
+        return 0;
+    }
+
+    write_run(writer, data.first(n));
+
+    writer_.store(writer + n, std::memory_order_release);
+    wait_.notify();
+    return n;
+}
+
+template<typename T, size_t Capacity, SlotLayout Layout, typename Wait, bool CacheRemoteIndex, typename Storage>
+bool SPSCQueue<T, Capacity, Layout, Wait, CacheRemoteIndex, Storage>::try_pop_bulk(std::span<T> dst) {
+    static_assert(sizeof(T) <= sizeof(Slot));
+    static_assert(alignof(T) <= alignof(Slot));
+
+    size_t reader = reader_.load(std::memory_order_relaxed);
+    if (readable_slots(reader, dst.size()) < dst.size()) {
+        return false;
+    }
+
+    read_run(reader, dst);
+
+    reader_.store(reader + dst.size(), std::memory_order_release);
+    return true;
+}
+
+template<typename T, size_t Capacity, SlotLayout Layout, typename Wait, bool CacheRemoteIndex, typename Storage>
+size_t SPSCQueue<T, Capacity, Layout, Wait, CacheRemoteIndex, Storage>::try_pop_burst(std::span<T> dst) {
+    static_assert(sizeof(T) <= sizeof(Slot));
+    static_assert(alignof(T) <= alignof(Slot));
+
+    size_t reader = reader_.load(std::memory_order_relaxed);
+    size_t n = std::min(dst.size(), readable_slots(reader, dst.size()));
+    if (n == 0) {
+        return 0;
+    }
+
+    read_run(reader, dst.first(n));
+
+    reader_.store(reader + n, std::memory_order_release);
+    return n;
+}
+
+template<typename T, size_t Capacity, SlotLayout Layout, typename Wait, bool CacheRemoteIndex, typename Storage>
+T* SPSCQueue<T, Capacity, Layout, Wait, CacheRemoteIndex, Storage>::try_reserve()
+    requires std::is_trivially_default_constructible_v<T> && std::is_trivially_destructible_v<T>
+{
+    size_t writer = writer_.load(std::memory_order_relaxed);
+    if (free_slots(writer, 1) < 1) {
+        return nullptr;
+    }
+
+    // trivial default construction, starts the lifetime without touching the slot
+    return new (buffer_[writer & wrapMask_].storage) T;
+}
+
+template<typename T, size_t Capacity, SlotLayout Layout, typename Wait, bool CacheRemoteIndex, typename Storage>
+void SPSCQueue<T, Capacity, Layout, Wait, CacheRemoteIndex, Storage>::commit() {
+    size_t writer = writer_.load(std::memory_order_relaxed);
+    writer_.store(writer + 1, std::memory_order_release);
+    wait_.notify();
+}
+
+template<typename T, size_t Capacity, SlotLayout Layout, typename Wait, bool CacheRemoteIndex, typename Storage>
+template<typename... Args>
+bool SPSCQueue<T, Capacity, Layout, Wait, CacheRemoteIndex, Storage>::try_emplace(Args&&... args) {
+    size_t writer = writer_.load(std::memory_order_relaxed);
+    if (free_slots(writer, 1) < 1) {
+        return false;
+    }
+
+    new (buffer_[writer & wrapMask_].storage) T(std::forward<Args>(args)...);
+
+    writer_.store(writer + 1, std::memory_order_release);
+    wait_.notify();
+    return true;
+}
+
+template<typename T, size_t Capacity, SlotLayout Layout, typename Wait, bool CacheRemoteIndex, typename Storage>
+const T* SPSCQueue<T, Capacity, Layout, Wait, CacheRemoteIndex, Storage>::front() {
+    size_t reader = reader_.load(std::memory_order_relaxed);
+    if (readable_slots(reader, 1) < 1) {
+        return nullptr;
+    }
+
+    return std::launder(reinterpret_cast<const T*>(buffer_[reader & wrapMask_].storage));
+}
+
+template<typename T, size_t Capacity, SlotLayout Layout, typename Wait, bool CacheRemoteIndex, typename Storage>
+void SPSCQueue<T, Capacity, Layout, Wait, CacheRemoteIndex, Storage>::pop_front() {
+    size_t reader = reader_.load(std::memory_order_relaxed);
+
+    if constexpr (!std::is_trivially_destructible_v<T>) {
+        T* ptr = std::launder(reinterpret_cast<T*>(buffer_[reader & wrapMask_].storage));
+        ptr->~T();
+    }
+
+    reader_.store(reader + 1, std::memory_order_release);
+}
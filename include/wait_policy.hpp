@@ -0,0 +1,153 @@
+#pragma once
+
+#include <atomic>
+#include <algorithm>
+#include <cstdint>
+#include <climits>
+#include <cpuid.h>
+#include <immintrin.h>
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+// A wait policy decides what a consumer does while its queue is empty.
+//
+// wait(watch, ready) returns once ready() returned true. `watch` is the
+// address the producer stores to when it publishes (the writer index or
+// the slot version), ready() performs the actual non-blocking pop.
+// notify() is called by the producer after every publish and must be
+// free for policies that never park.
+//
+// Policies are members of the queue, so a policy with state is shared
+// between the producer and all consumers.
+
+struct SpinWait {
+    template<typename Ready>
+    void wait(const void*, Ready&& ready) {
+        while (!ready()) {
+        }
+    }
+
+    void notify() {}
+};
+
+class PauseBackoffWait {
+public:
+    template<typename Ready>
+    void wait(const void*, Ready&& ready) {
+        uint32_t pauses = 1;
+        while (!ready()) {
+            for (uint32_t i = 0; i < pauses; ++i) {
+                _mm_pause();
+            }
+            pauses = std::min(pauses * 2, maxPauses_);
+        }
+    }
+
+    void notify() {}
+
+private:
+    static constexpr uint32_t maxPauses_ = 64;
+};
+
+// Sleeps in the C0.2 state until the watched cache line is written
+// (umonitor/umwait), falls back to PauseBackoffWait without WAITPKG.
+class UmwaitWait {
+public:
+    template<typename Ready>
+    void wait(const void* watch, Ready&& ready) {
+        if (!supported()) {
+            PauseBackoffWait{}.wait(watch, ready);
+            return;
+        }
+
+        while (!ready()) {
+            arm(watch);
+            // a store that landed before the monitor was armed would not wake us
+            if (ready()) {
+                return;
+            }
+            sleep(__rdtsc() + maxWaitCycles_);
+        }
+    }
+
+    void notify() {}
+
+    static bool supported() {
+        static const bool waitpkg = [] {
+            unsigned a, b, c, d;
+            return __get_cpuid_count(7, 0, &a, &b, &c, &d) && (c & (1u << 5));
+        }();
+        return waitpkg;
+    }
+
+private:
+    // the kernel caps a single umwait at IA32_UMWAIT_CONTROL (100k cycles by default)
+    static constexpr uint64_t maxWaitCycles_ = 100'000;
+
+    [[gnu::target("waitpkg")]] static void arm(const void* watch) {
+        _umonitor(const_cast<void*>(watch));
+    }
+
+    [[gnu::target("waitpkg")]] static void sleep(uint64_t deadline) {
+        // 0 selects C0.2: deeper sleep, slightly slower wake-up than C0.1
+        _umwait(0, deadline);
+    }
+};
+
+// Spins for SpinsBeforePark pause iterations, then parks on a futex.
+// The producer only pays for one locked RMW on the waiter count per
+// publish and only issues the wake syscall while someone is parked.
+// The futex is not process-private, so it also works in shared memory.
+template<uint32_t SpinsBeforePark = 0>
+class FutexWait {
+public:
+    template<typename Ready>
+    void wait(const void*, Ready&& ready) {
+        for (uint32_t i = 0; i < SpinsBeforePark; ++i) {
+            if (ready()) {
+                return;
+            }
+            _mm_pause();
+        }
+
+        while (true) {
+            uint32_t seq = seq_.load(std::memory_order_acquire);
+            // pairs with the RMW in notify(): either the producer sees us
+            // registered, or we read from its RMW and ready() sees its publish
+            waiters_.fetch_add(1, std::memory_order_acq_rel);
+
+            if (ready()) {
+                waiters_.fetch_sub(1, std::memory_order_relaxed);
+                return;
+            }
+
+            // returns immediately if notify() bumped seq_ after we read it
+            syscall(SYS_futex, reinterpret_cast<uint32_t*>(&seq_), FUTEX_WAIT, seq, nullptr, nullptr, 0);
+            waiters_.fetch_sub(1, std::memory_order_relaxed);
+
+            if (ready()) {
+                return;
+            }
+        }
+    }
+
+    void notify() {
+        // an RMW rather than a plain load, so it orders after the publish
+        // without a standalone fence (which TSAN does not model)
+        if (waiters_.fetch_add(0, std::memory_order_acq_rel) != 0) [[unlikely]] {
+            wake();
+        }
+    }
+
+private:
+    [[gnu::noinline, gnu::cold]] void wake() {
+        seq_.fetch_add(1, std::memory_order_release);
+        syscall(SYS_futex, reinterpret_cast<uint32_t*>(&seq_), FUTEX_WAKE, INT_MAX, nullptr, nullptr, 0);
+    }
+
+    alignas(64) std::atomic<uint32_t> seq_{0};
+    std::atomic<uint32_t> waiters_{0};
+};
+
+using HybridWait = FutexWait<4096>;
@@ -1,8 +1,13 @@
+#include <algorithm>
 #include <atomic>
+#include <cstdlib>
+#include <cstddef>
 #include <cstdint>
 #include <iostream>
-#include <random>
+#include <span>
 #include <stdexcept>
+#include <string>
+#include <string_view>
 #include <thread>
 #include <vector>
 #include <x86intrin.h>
@@ -11,86 +16,184 @@
 #include <rte_errno.h>
 #include <rte_ring.h>
 
+#include "bench_adapters.hpp"
+#include "bench_messages.hpp"
 #include "benchmark_utils.hpp"
 
-std::atomic<bool> running{true};
-
 constexpr uint64_t samples_count = 2'000'000;
 
-enum class Side : char {
-    None = 0,
-    Bid = 'B',
-    Ask = 'S'
-};
+// rte_ring moves pointers. Like a mempool, the adapter copies each message
+// into a slot of its own pool and enqueues the slot's address, and the
+// consumer copies it out, so both ends move the same bytes as with the value
+// queues. Free slots sit in a second ring: the producer takes one per push
+// and a consumer hands it back only after copying the message out, so a
+// consumer preempted between dequeue and copy can't see its slot reused.
+// SP enqueue, MC/RTS dequeue: each message goes to one consumer.
+template<typename Msg = BestLvlChange>
+struct RteRingBench {
+    using value_type = Msg;
+    static constexpr bool fan_out = false;
+    static constexpr int max_consumers = 64;
+    static constexpr std::size_t max_burst = 64;
+    static constexpr unsigned ring_size = 1u << 20;
+
+    RteRingBench()
+    : ring{rte_ring_create("spmc_ring", ring_size, rte_socket_id(), RING_F_SP_ENQ | RING_F_MC_RTS_DEQ)},
+      // consumers return slots concurrently, only the producer takes them;
+      // twice the pool since a ring holds one less than its size
+      free_slots{rte_ring_create("spmc_free_slots", 2 * ring_size, rte_socket_id(), RING_F_SC_DEQ)},
+      pool(ring_size)
+    {
+        if (!ring || !free_slots) {
+            rte_ring_free(ring);
+            rte_ring_free(free_slots);
+            throw std::runtime_error(std::string("rte_ring_create failed: ") + rte_strerror(rte_errno));
+        }
+        for (Msg& slot : pool) {
+            rte_ring_enqueue(free_slots, &slot);
+        }
+    }
 
-struct BestLvlChange {
-    uint64_t padding;
-    uint64_t qty;
-    uint32_t price;
-    Side side;
+    ~RteRingBench() {
+        rte_ring_free(ring);
+        rte_ring_free(free_slots);
+    }
+
+    RteRingBench(const RteRingBench&) = delete;
+    RteRingBench& operator=(const RteRingBench&) = delete;
+
+    struct Producer {
+        RteRingBench* bench;
+        // kept across a failed enqueue, so a full ring doesn't leak slots
+        Msg* slot = nullptr;
+
+        bool try_push(const Msg& value) {
+            if (!slot) {
+                void* obj = nullptr;
+                if (rte_ring_dequeue(bench->free_slots, &obj) != 0) {
+                    return false;
+                }
+                slot = static_cast<Msg*>(obj);
+            }
+            *slot = value;
+            if (rte_ring_enqueue(bench->ring, slot) != 0) {
+                return false;
+            }
+            slot = nullptr;
+            return true;
+        }
+    };
+
+    struct Consumer {
+        rte_ring* ring;
+        rte_ring* free_slots;
+
+        bool try_pop(Msg& dst) {
+            void* obj = nullptr;
+            if (rte_ring_dequeue(ring, &obj) != 0) {
+                return false;
+            }
+            dst = *static_cast<const Msg*>(obj);
+            rte_ring_enqueue(free_slots, obj);
+            return true;
+        }
+
+        std::size_t try_pop_burst(std::span<Msg> dst) {
+            void* objs[max_burst] = {};
+            unsigned n = rte_ring_dequeue_burst(ring, objs, std::min(dst.size(), max_burst), nullptr);
+            for (unsigned i = 0; i < n; ++i) {
+                dst[i] = *static_cast<const Msg*>(objs[i]);
+            }
+            rte_ring_enqueue_bulk(free_slots, objs, n, nullptr);
+            return n;
+        }
+    };
+
+    Producer producer() { return {this}; }
+    Consumer make_consumer() { return {ring, free_slots}; }
+
+    rte_ring* ring;
+    rte_ring* free_slots;
+    std::vector<Msg> pool;
 };
 
-std::vector<BestLvlChange> make_random_changes(
-    std::size_t n,
-    uint32_t min_price,
-    uint32_t max_price,
-    uint64_t min_qty,
-    uint64_t max_qty,
-    uint64_t seed = 123456789
-) {
-    std::mt19937_64 rng(seed);
-
-    std::uniform_int_distribution<uint32_t> price_dist(min_price, max_price);
-    std::uniform_int_distribution<uint64_t> qty_dist(min_qty, max_qty);
-    std::uniform_int_distribution<int> side_dist(0, 1);
-
-    std::vector<BestLvlChange> v;
-    v.reserve(n);
-
-    for (std::size_t i = 0; i < n; ++i) {
-        BestLvlChange c;
-        c.price = price_dist(rng);
-        c.qty = qty_dist(rng);
-        c.side = side_dist(rng) == 0 ? Side::Bid : Side::Ask;
-        v.push_back(c);
+// same shape as run_mpsc_bench in mpsc_bench.cpp: samples_count messages
+// split across the producers, push and pop cost of successful calls
+int run_mpsc_ring(int producer_count) {
+    constexpr unsigned ring_size = 1u << 16;
+
+    // multi-producer enqueue is the default, only the dequeue side is single
+    rte_ring* ring = rte_ring_create("mpsc_ring", ring_size, rte_socket_id(), RING_F_SC_DEQ);
+    if (!ring) {
+        std::cerr << "rte_ring_create failed: " << rte_strerror(rte_errno) << "\n";
+        return 1;
     }
 
-    return v;
-}
+    auto changes = make_random_changes(samples_count, 1000, 100'000, 10, 100'000);
+    const uint64_t per_producer = samples_count / producer_count;
+    const uint64_t total = per_producer * producer_count;
+
+    std::vector<std::vector<uint64_t>> push_samples(producer_count);
+    std::atomic<int> ready{0};
+
+    std::vector<std::thread> producers;
+    producers.reserve(producer_count);
+    for (int p = 0; p < producer_count; ++p) {
+        producers.emplace_back([&, p] {
+            pin_thread_to_cpu(p + 2);
+            auto& samples = push_samples[p];
+            samples.resize(per_producer);
+
+            ready.fetch_add(1, std::memory_order_release);
+            while (ready.load(std::memory_order_acquire) != producer_count + 1) {
+            }
+
+            unsigned aux;
+            uint64_t i = 0;
+            while (i < per_producer) {
+                auto t0 = __rdtscp(&aux);
+                int rc = rte_ring_enqueue(ring, &changes[p * per_producer + i]);
+                if (rc == 0) {
+                    auto t1 = __rdtscp(&aux);
+                    samples[i++] = t1 - t0;
+                }
+            }
+        });
+    }
 
-void consumer(rte_ring* ring, uint64_t consumer_id) {
-    pin_thread_to_cpu(static_cast<int>(consumer_id + 2));
+    while (ready.load(std::memory_order_acquire) != producer_count) {
+    }
+    ready.fetch_add(1, std::memory_order_release);
 
+    std::vector<uint64_t> pop_samples(total);
     void* obj = nullptr;
-
-    std::vector<uint64_t> samples(samples_count);
-
-    unsigned aux_end;
+    unsigned aux;
     uint64_t i = 0;
-    while (true && i < samples_count) {
-        auto t0 = __rdtscp(&aux_end);
+    while (i < total) {
+        auto t0 = __rdtscp(&aux);
         int rc = rte_ring_dequeue(ring, &obj);
-        bool read = (rc == 0);
-
-        if (read) {
-            auto t1 = __rdtscp(&aux_end);
-            samples[i++] = t1 - t0;
+        if (rc == 0) {
+            auto t1 = __rdtscp(&aux);
+            pop_samples[i++] = t1 - t0;
         }
+    }
 
-        if (!running.load(std::memory_order_relaxed) && !read) {
-            break;
-        }
+    for (auto& producer : producers) {
+        producer.join();
     }
+    rte_ring_free(ring);
 
-    if (i != samples_count) {
-        throw std::runtime_error("failed to process all messages. Only: " + std::to_string(i));
+    std::vector<uint64_t> all_push;
+    all_push.reserve(total);
+    for (const auto& samples : push_samples) {
+        all_push.insert(all_push.end(), samples.begin(), samples.end());
     }
 
-    export_latency_samples_csv(
-        samples,
-        "../results/consumer_latency_" + std::to_string(consumer_id) + ".csv",
-        "consumer_" + std::to_string(consumer_id)
-    );
+    const std::string label = std::to_string(producer_count) + "p";
+    std::cout << "rte_ring mp/sc producers: " << producer_count << '\n';
+    export_latency_samples_csv(all_push, "../results/dpdk_mpsc_push_" + label + ".csv", "rte_ring producer (" + label + ")");
+    export_latency_samples_csv(pop_samples, "../results/dpdk_mpsc_pop_" + label + ".csv", "rte_ring consumer (" + label + ")");
+    return 0;
 }
 
 int main(int argc, char** argv) {
@@ -102,56 +205,57 @@ int main(int argc, char** argv) {
         return 1;
     }
 
-    constexpr unsigned ring_size = 1u << 22;
-
-    rte_ring* ring = rte_ring_create(
-        "spmc_ring",
-        ring_size,
-        rte_socket_id(),
-        RING_F_SP_ENQ | RING_F_MC_RTS_DEQ
-    );
-    if (!ring) {
-        std::cerr << "rte_ring_create failed: " << rte_strerror(rte_errno) << "\n";
-        return 1;
-    }
+    // application arguments follow the EAL ones, e.g. bench_dpdk -l 1-12 -- mpsc
+    argc -= eal_rc;
+    argv += eal_rc;
 
-    auto changes = make_random_changes(samples_count, 1000, 100'000, 10, 100'000);
-    constexpr int thread_count = 2;
-
-    std::vector<std::thread> threads;
-    threads.reserve(thread_count);
-
-    for (uint64_t i = 0; i < static_cast<uint64_t>(thread_count); ++i) {
-        threads.emplace_back(consumer, ring, i);
-    }
-
-    std::vector<uint64_t> samples(samples_count);
-
-    unsigned aux_start;
-    for (uint64_t i = 0; i < samples_count; ++i) {
-        auto t0 = __rdtscp(&aux_start);
-        int rc = rte_ring_enqueue(ring, const_cast<BestLvlChange*>(&changes[i]));
-        auto t1 = __rdtscp(&aux_start);
-
-        if (rc != 0) {
-            std::cerr << "enqueue failed (ring full): rc=" << rc << "\n";
-            break;
+    if (argc > 1 && std::string_view(argv[1]) == "mpsc") {
+        for (int producers = 1; producers <= 10; ++producers) {
+            if (int rc = run_mpsc_ring(producers); rc != 0) {
+                return rc;
+            }
         }
+        return 0;
+    }
 
-        for (int k = 0; k < 3; ++k) {
-            _mm_pause();
+    if (argc > 1 && std::string_view(argv[1]) == "work") {
+        // rte_ring MC/RTS against SPMCWorkQueue, one and 32 messages per dequeue,
+        // with per-thread perf counters to see where the head CAS contends
+        int consumer_count = argc > 2 ? std::atoi(argv[2]) : 2;
+        for (std::size_t burst : {std::size_t{1}, std::size_t{32}}) {
+            const std::string suffix = "_" + std::to_string(consumer_count) + "c_" + std::to_string(burst) + "b";
+            const QueueBenchOptions options{.consumers = consumer_count, .burst = burst, .perf_counters = true};
+            run_queue_bench<RteRingBench<>>("rte_ring" + suffix, options);
+            run_queue_bench<SharedQueueBench<SPMCWorkQueue<BestLvlChange, 1u << 20>>>("work_queue" + suffix, options);
         }
-
-        samples[i] = t1 - t0;
+        return 0;
     }
 
-    running.store(false, std::memory_order_release);
+    if (argc > 1 && std::string_view(argv[1]) == "e2e") {
+        // push-to-pop latency, back to back and paced
+        int consumer_count = argc > 2 ? std::atoi(argv[2]) : 2;
+        run_queue_bench<RteRingBench<StampedChange>>("e2e_rte_ring", {.consumers = consumer_count, .end_to_end = true});
+        const SendSchedule paced = SendSchedule::constant(1'000'000, queue_bench_messages, tsc_frequency());
+        run_queue_bench<RteRingBench<StampedChange>>(
+            "e2e_rte_ring_paced", {.consumers = consumer_count, .end_to_end = true, .schedule = &paced}
+        );
+        return 0;
+    }
 
-    for (auto& t : threads) {
-        t.join();
+    if (argc > 1 && std::string_view(argv[1]) == "load") {
+        // latency knee under open-loop load: load [consumers] [constant|poisson|replay] [capture file]
+        int consumer_count = argc > 2 ? std::atoi(argv[2]) : 2;
+        const RateSweepOptions options{
+            .run = {.consumers = consumer_count},
+            .arrivals = argc > 3 ? parse_arrivals(argv[3]) : Arrivals::Constant,
+            .capture = argc > 4 ? argv[4] : "",
+        };
+        run_rate_sweep<RteRingBench<StampedChange>>("load_rte_ring", options);
+        run_rate_sweep<SharedQueueBench<SPMCWorkQueue<StampedChange, 1u << 20>>>("load_work_queue", options);
+        return 0;
     }
 
-    export_latency_samples_csv(samples, "../results/push.csv", "producer");
-    std::cout << "Done\n";
+    // label "" keeps the original push.csv and consumer_latency_<id>.csv names
+    run_queue_bench<RteRingBench<>>("", {.consumers = 2});
     return 0;
 }
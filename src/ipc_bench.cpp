@@ -0,0 +1,175 @@
+#include "ipc_bench.hpp"
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <sys/wait.h>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+#include <x86intrin.h>
+
+#include "benchmark_utils.hpp"
+#include "ipc_channel.hpp"
+#include "spmc_queue_trivially_copiable.hpp"
+#include "spsc_queue.hpp"
+
+namespace {
+
+constexpr std::size_t kMessages = 500'000;
+// paced producer, so the samples are hand-off latency and not queueing delay
+constexpr uint64_t kGapCycles = 2'000;
+constexpr uint64_t kCapacity = 1 << 16;
+
+struct StampedMsg {
+    uint64_t sent_tsc;
+    uint64_t seq;
+};
+
+using SPSCIPCQueue = SPSCQueue<StampedMsg, kCapacity, SlotLayout::CacheLine, SpinWait, true, EmbeddedStorage>;
+using SPMCIPCQueue = SPMCQueue<
+    StampedMsg, kCapacity, SpinWait, OverrunPolicy::Abort, default_seqlock_read, VersionLayout::InSlot, EmbeddedStorage
+>;
+
+// what the producer and consumers share, in-process or in a channel
+template<typename Queue>
+struct Shared {
+    std::atomic<int> ready{0};
+    Queue queue;
+};
+
+void send(SPSCIPCQueue& queue, const StampedMsg& msg) {
+    while (!queue.try_push(msg)) {
+    }
+}
+
+void send(SPMCIPCQueue& queue, const StampedMsg& msg) {
+    queue.push(msg);
+}
+
+std::vector<uint64_t> receive(Shared<SPSCIPCQueue>& shared) {
+    std::vector<uint64_t> samples(kMessages);
+    shared.ready.fetch_add(1, std::memory_order_release);
+
+    StampedMsg msg;
+    unsigned aux;
+    for (std::size_t i = 0; i < kMessages; ++i) {
+        while (!shared.queue.try_pop(msg)) {
+        }
+        samples[i] = __rdtscp(&aux) - msg.sent_tsc;
+        if (msg.seq != i) {
+            throw std::runtime_error("ipc bench received messages out of order");
+        }
+    }
+    return samples;
+}
+
+std::vector<uint64_t> receive(Shared<SPMCIPCQueue>& shared) {
+    std::vector<uint64_t> samples(kMessages);
+    // the cursor lives in this thread/process, only the ring is shared
+    auto consumer = shared.queue.make_consumer();
+    shared.ready.fetch_add(1, std::memory_order_release);
+
+    StampedMsg msg;
+    unsigned aux;
+    for (std::size_t i = 0; i < kMessages; ++i) {
+        while (!consumer.pop(msg)) {
+        }
+        samples[i] = __rdtscp(&aux) - msg.sent_tsc;
+        if (msg.seq != i) {
+            throw std::runtime_error("ipc bench received messages out of order");
+        }
+    }
+    return samples;
+}
+
+template<typename Queue>
+void produce(Shared<Queue>& shared, int consumer_count) {
+    while (shared.ready.load(std::memory_order_acquire) != consumer_count) {
+    }
+
+    unsigned aux;
+    uint64_t next = __rdtscp(&aux);
+    for (std::size_t i = 0; i < kMessages; ++i) {
+        next += kGapCycles;
+        while (__rdtscp(&aux) < next) {
+            _mm_pause();
+        }
+        send(shared.queue, StampedMsg{__rdtscp(&aux), i});
+    }
+}
+
+std::string csv_name(const std::string& label, int consumer_index) {
+    return "../results/ipc_latency_" + label + "_" + std::to_string(consumer_index) + ".csv";
+}
+
+template<typename Queue>
+void run_in_process(int consumer_count, const std::string& label) {
+    auto shared = std::make_unique<Shared<Queue>>();
+
+    std::vector<std::thread> threads;
+    for (int i = 0; i < consumer_count; ++i) {
+        threads.emplace_back([&, i] {
+            pin_thread_to_cpu(i + 2);
+            auto samples = receive(*shared);
+            export_latency_samples_csv(samples, csv_name(label, i), label + " consumer " + std::to_string(i));
+        });
+    }
+
+    produce(*shared, consumer_count);
+
+    for (auto& thread : threads) {
+        thread.join();
+    }
+}
+
+template<typename Queue>
+void run_cross_process(int consumer_count, const std::string& label) {
+    const std::string name = "spmc_bench_" + label;
+    IPCChannel<Shared<Queue>>::unlink(name);
+    auto channel = IPCChannel<Shared<Queue>>::create(name, ShmBacking::Auto);
+    std::cout << label << " huge pages: " << (channel.huge_pages() ? "yes" : "no") << '\n';
+
+    std::vector<pid_t> children;
+    for (int i = 0; i < consumer_count; ++i) {
+        pid_t pid = fork();
+        if (pid < 0) {
+            throw std::runtime_error("fork failed");
+        }
+        if (pid == 0) {
+            // attach like an unrelated process would, the queue ends up at a different address
+            pin_thread_to_cpu(i + 2);
+            auto attached = IPCChannel<Shared<Queue>>::attach(name);
+            auto samples = receive(*attached);
+            export_latency_samples_csv(samples, csv_name(label, i), label + " consumer " + std::to_string(i));
+            std::cout.flush();
+            _exit(0);
+        }
+        children.push_back(pid);
+    }
+
+    produce(*channel, consumer_count);
+
+    int failed = 0;
+    for (pid_t pid : children) {
+        int status;
+        waitpid(pid, &status, 0);
+        failed += !WIFEXITED(status) || WEXITSTATUS(status) != 0;
+    }
+    IPCChannel<Shared<Queue>>::unlink(name);
+
+    if (failed) {
+        throw std::runtime_error("ipc bench consumer process failed");
+    }
+}
+
+}  // namespace
+
+void run_ipc_bench(int consumer_count) {
+    run_in_process<SPSCIPCQueue>(1, "spsc_threads");
+    run_cross_process<SPSCIPCQueue>(1, "spsc_processes");
+    run_in_process<SPMCIPCQueue>(consumer_count, "spmc_threads");
+    run_cross_process<SPMCIPCQueue>(consumer_count, "spmc_processes");
+}
@@ -1,134 +1,173 @@
-#include <atomic>
 #include <cstdlib>
-#include <iostream>
-#include <thread>
-#include <vector>
-#include <random>
-#include <x86intrin.h>
+#include <ctime>
+#include <string>
+#include <string_view>
+#include "bench_adapters.hpp"
 #include "benchmark_utils.hpp"
+#include "ipc_bench.hpp"
+#include "mpmc_bench.hpp"
+#include "mpsc_bench.hpp"
 #include "spmc_burst_bench.hpp"
-#include "spsc_queue.hpp"
-
-std::atomic running{true};
-
-constexpr uint64_t samples_count = 2'000'000;
-
-enum class Side : char {
-    None = 0,
-    Bid = 'B',
-    Ask = 'S'
-};
-
-struct BestLvlChange {
-    uint64_t qty;
-    uint32_t price;
-    Side side;
-};
-
-std::vector<BestLvlChange> make_random_changes(
-    std::size_t n,
-    uint32_t min_price,
-    uint32_t max_price,
-    uint64_t min_qty,
-    uint64_t max_qty,
-    uint64_t seed = 123456789
-) {
-    std::mt19937_64 rng(seed);
-
-    std::uniform_int_distribution<uint32_t> price_dist(min_price, max_price);
-    std::uniform_int_distribution<uint64_t> qty_dist(min_qty, max_qty);
-    std::uniform_int_distribution<int> side_dist(0, 1);
-
-    std::vector<BestLvlChange> v;
-    v.reserve(n);
-
-    for (std::size_t i = 0; i < n; ++i) {
-        BestLvlChange c;
-        c.price = price_dist(rng);
-        c.qty = qty_dist(rng);
-        c.side = side_dist(rng) == 0 ? Side::Bid : Side::Ask;
-        v.push_back(c);
-    }
+#include "wait_bench.hpp"
 
-    return v;
+void sleep_ns(long ns) {
+    timespec ts;
+    ts.tv_sec  = ns / 1'000'000'000L;
+    ts.tv_nsec = ns % 1'000'000'000L;
+    nanosleep(&ts, nullptr);
 }
 
-void consumer_spsc(SPSCQueue<BestLvlChange>& queue) {
-    pin_thread_to_cpu(2);
+void spsc_bench() {
+    // before/after for the cached remote index
+    constexpr std::size_t capacity = defaultCapacity_<BestLvlChange>;
+    run_queue_bench<SPSCQueueBench<SPSCQueue<BestLvlChange, capacity, SlotLayout::CacheLine, SpinWait, false>>>("uncached_index");
+    run_queue_bench<SPSCQueueBench<SPSCQueue<BestLvlChange, capacity, SlotLayout::CacheLine, SpinWait, true>>>("cached_index");
+    // 4 BestLvlChange per cache line instead of 1
+    run_queue_bench<SPSCQueueBench<SPSCQueue<BestLvlChange, capacity, SlotLayout::Packed>>>("packed_slots");
+}
 
-    BestLvlChange best_lvl_change;
-    std::vector<uint64_t> samples(samples_count);
+// cost scaling for messages spanning several cache lines
+void spsc_message_size_bench() {
+    run_queue_bench<SPSCQueueBench<SPSCQueue<PaddedChange<128>>>>("msg_128");
+    run_queue_bench<SPSCQueueBench<SPSCQueue<PaddedChange<256>>>>("msg_256");
+    run_queue_bench<SPSCQueueBench<SPSCQueue<PaddedChange<512>>>>("msg_512");
+}
 
-    unsigned aux_end;
-    int i = 0;
-    while (true && i < samples_count) {
-        auto t0 = __rdtscp(&aux_end);
-        bool read = queue.try_pop(best_lvl_change);
+// the same harness, payload and pinning for every queue
+void queue_comparison_bench() {
+    run_queue_bench<SPSCQueueBench<SPSCQueue<BestLvlChange>>>("cmp_spsc_queue");
+    run_queue_bench<SPMCQueueBench<SPMCQueue<BestLvlChange, queue_bench_messages>>>("cmp_spmc_queue");
+    run_queue_bench<SPSCBufferBench<BestLvlChange>>("cmp_spsc_buffer");
+#ifndef __SANITIZE_THREAD__
+    run_queue_bench<ReaderWriterQueueBench<BestLvlChange>>("cmp_moodycamel");
+#endif
+}
 
-        if (read) {
-            auto t1 = __rdtscp(&aux_end);
-            samples[i++] = t1 - t0;
-        }
+// push-to-pop latency from a TSC stamped into each message, back to back
+// (including time queued behind earlier messages) and paced open loop
+void end_to_end_bench(int consumer_count) {
+    constexpr double paced_rate = 1'000'000;
+    const SendSchedule paced = SendSchedule::constant(paced_rate, queue_bench_messages, tsc_frequency());
 
-        if (!running.load(std::memory_order_relaxed) && !read) break;
-    }
+    run_queue_bench<SPSCQueueBench<SPSCQueue<StampedChange>>>("e2e_spsc", {.end_to_end = true});
+    run_queue_bench<SPSCQueueBench<SPSCQueue<StampedChange>>>(
+        "e2e_spsc_paced", {.end_to_end = true, .schedule = &paced}
+    );
+    run_queue_bench<SPMCQueueBench<SPMCQueue<StampedChange, queue_bench_messages>>>(
+        "e2e_spmc", {.consumers = consumer_count, .end_to_end = true}
+    );
+    run_queue_bench<SPMCQueueBench<SPMCQueue<StampedChange, queue_bench_messages>>>(
+        "e2e_spmc_paced", {.consumers = consumer_count, .end_to_end = true, .schedule = &paced}
+    );
+}
 
-    if (i != samples_count) {
-        throw std::runtime_error("failed to process all messages. Something is seriously wrong");
-    }
+// per-thread cycles, cache misses and HITMs next to latency, so contention
+// can be pinned on the producer or the consumers
+void perf_counter_bench(int consumer_count) {
+    const QueueBenchOptions options{.consumers = consumer_count, .perf_counters = true};
 
-    export_latency_samples_csv(
-        samples,
-        "../results/spsc_consumer_latency.csv",
-        "consumer_spsc"
-    );
+    run_queue_bench<SPSCQueueBench<SPSCQueue<BestLvlChange>>>("perf_spsc", {.perf_counters = true});
+    run_queue_bench<SPMCQueueBench<SPMCQueue<BestLvlChange, queue_bench_messages>>>("perf_spmc", options);
+    run_queue_bench<SharedQueueBench<SPMCWorkQueue<BestLvlChange, 1u << 20>>>("perf_work_queue", options);
+    run_queue_bench<SharedQueueBench<MPMCQueue<BestLvlChange, 1u << 20>>>("perf_mpmc", options);
 }
 
-void sleep_ns(long ns) {
-    timespec ts;
-    ts.tv_sec  = ns / 1'000'000'000L;
-    ts.tv_nsec = ns % 1'000'000'000L;
-    nanosleep(&ts, nullptr);
+// latency knee of each queue under open-loop load at rising rates
+void load_bench(int consumer_count, Arrivals arrivals, const std::string& capture) {
+    RateSweepOptions options;
+    options.arrivals = arrivals;
+    options.capture = capture;
+    run_rate_sweep<SPSCQueueBench<SPSCQueue<StampedChange>>>("load_spsc", options);
+
+    options.run.consumers = consumer_count;
+    run_rate_sweep<SPMCQueueBench<SPMCQueue<StampedChange, queue_bench_messages>>>("load_spmc", options);
+    run_rate_sweep<SharedQueueBench<SPMCWorkQueue<StampedChange, 1u << 20>>>("load_work_queue", options);
 }
 
-void spsc_bench() {
-    running.store(true, std::memory_order_release);
+int main(int argc, char** argv) {
+    pin_thread_to_cpu(1);
+
+    if (argc > 1 && std::string_view(argv[1]) == "spsc") {
+        spsc_bench();
+        return 0;
+    }
+
+    if (argc > 1 && std::string_view(argv[1]) == "spsc_sizes") {
+        spsc_message_size_bench();
+        return 0;
+    }
+
+    if (argc > 1 && std::string_view(argv[1]) == "compare") {
+        queue_comparison_bench();
+        return 0;
+    }
 
-    SPSCQueue<BestLvlChange> spsc_queue;
+    if (argc > 1 && std::string_view(argv[1]) == "e2e") {
+        int consumer_count = argc > 2 ? std::atoi(argv[2]) : 2;
+        end_to_end_bench(consumer_count);
+        return 0;
+    }
 
-    auto changes = make_random_changes(samples_count, 1000, 100'000, 10, 100'000);
-    std::thread consumer(consumer_spsc, std::ref(spsc_queue));
+    if (argc > 1 && std::string_view(argv[1]) == "perf") {
+        int consumer_count = argc > 2 ? std::atoi(argv[2]) : 2;
+        perf_counter_bench(consumer_count);
+        return 0;
+    }
 
-    unsigned aux_start;
-    std::vector<uint64_t> samples(samples_count);
-    int i = 0;
-    while (i < samples_count) {
-        auto t0 = __rdtscp(&aux_start);
-        bool res = spsc_queue.try_push(changes[i]);
+    if (argc > 1 && std::string_view(argv[1]) == "load") {
+        // load [consumers] [constant|poisson|replay] [capture file]
+        int consumer_count = argc > 2 ? std::atoi(argv[2]) : 2;
+        Arrivals arrivals = argc > 3 ? parse_arrivals(argv[3]) : Arrivals::Constant;
+        load_bench(consumer_count, arrivals, argc > 4 ? argv[4] : "");
+        return 0;
+    }
 
-        if (res) {
-            auto t1 = __rdtscp(&aux_start);
-            samples[i] = t1 - t0;
-            i++;
+    if (argc > 1 && std::string_view(argv[1]) == "wait") {
+        run_wait_policy_bench();
+        return 0;
+    }
+
+    if (argc > 1 && std::string_view(argv[1]) == "bulk") {
+        for (int i = 2; i <= 10; ++i) {
+            run_spmc_burst_bench(i);
+            run_spmc_burst_bench_bulk(i);
         }
+        return 0;
     }
 
-    running.store(false, std::memory_order_release);
-    consumer.join();
+    if (argc > 1 && std::string_view(argv[1]) == "ring_sizes") {
+        int consumer_count = argc > 2 ? std::atoi(argv[2]) : 2;
+        run_spmc_ring_size_sweep(consumer_count);
+        return 0;
+    }
 
-    std::cout << "Sizeof struct: " << sizeof(BestLvlChange) << '\n';
-    export_latency_samples_csv(samples, "../results/push.csv", "producer");
-    std::cout << "Done" << '\n';
+    if (argc > 1 && std::string_view(argv[1]) == "mpsc") {
+        run_mpsc_bench();
+        return 0;
+    }
 
-}
+    if (argc > 1 && std::string_view(argv[1]) == "mpmc") {
+        run_mpmc_bench();
+        return 0;
+    }
 
-int main(int argc, char** argv) {
-    int spmc_consumer_count = 2;
-    if (argc > 1) {
-        spmc_consumer_count = std::atoi(argv[1]);
+    if (argc > 1 && std::string_view(argv[1]) == "alloc") {
+        int consumer_count = argc > 2 ? std::atoi(argv[2]) : 2;
+        run_spmc_alloc_bench(consumer_count);
+        return 0;
     }
 
-    pin_thread_to_cpu(1);
+    if (argc > 1 && std::string_view(argv[1]) == "ipc") {
+        int consumer_count = argc > 2 ? std::atoi(argv[2]) : 2;
+        run_ipc_bench(consumer_count);
+        return 0;
+    }
+
+    if (argc > 1 && std::string_view(argv[1]) == "versions") {
+        int consumer_count = argc > 2 ? std::atoi(argv[2]) : 10;
+        run_spmc_version_layout_bench(consumer_count);
+        return 0;
+    }
 
     for (int i = 2; i <= 10; ++i) {
         run_spmc_burst_bench(i);
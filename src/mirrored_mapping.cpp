@@ -0,0 +1,83 @@
+#include "mirrored_mapping.hpp"
+#include <cerrno>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+#include <sys/mman.h>
+#include <unistd.h>
+
+namespace {
+
+[[noreturn]] void throw_errno(const char* what) {
+    throw std::runtime_error(std::string(what) + " failed: " + std::strerror(errno));
+}
+
+}  // namespace
+
+size_t MirroredMapping::page_size() {
+    static const size_t pageSize = static_cast<size_t>(sysconf(_SC_PAGESIZE));
+    return pageSize;
+}
+
+MirroredMapping::MirroredMapping(size_t size) {
+    size = (size + page_size() - 1) & ~(page_size() - 1);
+
+    int fd = memfd_create("spsc_ring", MFD_CLOEXEC);
+    if (fd < 0) {
+        throw_errno("memfd_create");
+    }
+
+    if (ftruncate(fd, static_cast<off_t>(size)) != 0) {
+        close(fd);
+        throw_errno("ftruncate");
+    }
+
+    try {
+        map(fd, 0, size);
+    } catch (...) {
+        close(fd);
+        throw;
+    }
+
+    // the mappings keep the pages alive
+    close(fd);
+}
+
+MirroredMapping::MirroredMapping(int fd, size_t offset, size_t size) {
+    map(fd, offset, size);
+}
+
+MirroredMapping::~MirroredMapping() {
+    munmap(base_, length_);
+}
+
+void MirroredMapping::map(int fd, size_t offset, size_t size) {
+    if (size == 0 || offset % page_size() != 0 || size % page_size() != 0) {
+        throw std::invalid_argument("mirrored ring offset and size must be non-zero multiples of the page size");
+    }
+
+    const size_t length = offset + 2 * size;
+
+    // reserve the whole range first so nothing else can land between the two copies
+    void* base = mmap(nullptr, length, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+    if (base == MAP_FAILED) {
+        throw_errno("mmap reserve");
+    }
+
+    auto* bytes = static_cast<std::byte*>(base);
+
+    void* first = mmap(bytes, offset + size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_FIXED, fd, 0);
+    void* second = first == MAP_FAILED
+        ? MAP_FAILED
+        : mmap(bytes + offset + size, size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_FIXED, fd, static_cast<off_t>(offset));
+
+    if (second == MAP_FAILED) {
+        int err = errno;
+        munmap(base, length);
+        errno = err;
+        throw_errno("mmap mirror");
+    }
+
+    base_ = bytes;
+    length_ = length;
+}
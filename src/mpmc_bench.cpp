@@ -0,0 +1,145 @@
+#include "mpmc_bench.hpp"
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <iostream>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+#include <x86intrin.h>
+
+#include "benchmark_utils.hpp"
+#include "mpmc_queue.hpp"
+
+namespace {
+
+// split across the producers, so every run moves the same amount of data
+constexpr std::size_t kTotalMessages = 2'000'000;
+// producers + consumers, the main thread only starts and joins them
+constexpr int kMaxThreads = 8;
+
+struct JobMsg {
+    uint64_t seq;
+    uint32_t producer;
+    uint32_t payload;
+};
+
+template<IndexLayout Indices>
+using Queue = MPMCQueue<JobMsg, 1 << 16, SpinWait, Indices>;
+
+// one producer/consumer count: push and pop cost of successful calls and
+// end-to-end throughput
+template<IndexLayout Indices>
+void run_threads(int producer_count, int consumer_count, const std::string& layout) {
+    Queue<Indices> queue;
+
+    const std::size_t per_producer = kTotalMessages / producer_count;
+    const std::size_t total = per_producer * producer_count;
+
+    std::vector<std::vector<uint64_t>> push_samples(producer_count);
+    std::vector<std::vector<uint64_t>> pop_samples(consumer_count);
+    std::atomic<std::size_t> popped{0};
+    std::atomic<uint64_t> seq_sum{0};
+    std::atomic<int> ready{0};
+    const int thread_count = producer_count + consumer_count;
+
+    // the main thread releases everyone at once and starts the clock
+    auto start_together = [&] {
+        ready.fetch_add(1, std::memory_order_release);
+        while (ready.load(std::memory_order_acquire) != thread_count + 1) {
+        }
+    };
+
+    std::vector<std::thread> threads;
+    threads.reserve(thread_count);
+    for (int p = 0; p < producer_count; ++p) {
+        threads.emplace_back([&, p] {
+            pin_thread_to_cpu(p + 2);
+            auto& samples = push_samples[p];
+            samples.resize(per_producer);
+            start_together();
+
+            unsigned aux;
+            std::size_t i = 0;
+            while (i < per_producer) {
+                JobMsg msg{i, static_cast<uint32_t>(p), static_cast<uint32_t>(i * 7)};
+                auto t0 = __rdtscp(&aux);
+                bool pushed = queue.try_push(msg);
+                if (pushed) {
+                    auto t1 = __rdtscp(&aux);
+                    samples[i++] = t1 - t0;
+                }
+            }
+        });
+    }
+
+    for (int c = 0; c < consumer_count; ++c) {
+        threads.emplace_back([&, c] {
+            pin_thread_to_cpu(producer_count + c + 2);
+            auto& samples = pop_samples[c];
+            samples.reserve(total);
+            start_together();
+
+            JobMsg msg;
+            unsigned aux;
+            uint64_t sum = 0;
+            while (popped.load(std::memory_order_relaxed) < total) {
+                auto t0 = __rdtscp(&aux);
+                bool got = queue.try_pop(msg);
+                if (got) {
+                    auto t1 = __rdtscp(&aux);
+                    samples.push_back(t1 - t0);
+                    sum += msg.seq;
+                    popped.fetch_add(1, std::memory_order_relaxed);
+                }
+            }
+            seq_sum.fetch_add(sum, std::memory_order_relaxed);
+        });
+    }
+
+    while (ready.load(std::memory_order_acquire) != thread_count) {
+    }
+    auto begin = std::chrono::steady_clock::now();
+    ready.fetch_add(1, std::memory_order_release);
+
+    for (auto& thread : threads) {
+        thread.join();
+    }
+    auto elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - begin).count();
+
+    // every message exactly once: each producer sent seq 0..per_producer-1
+    const uint64_t expected = producer_count * (per_producer * (per_producer - 1) / 2);
+    if (popped.load() != total || seq_sum.load() != expected) {
+        throw std::runtime_error("mpmc bench: lost or duplicated messages");
+    }
+
+    std::vector<uint64_t> all_push;
+    all_push.reserve(total);
+    for (const auto& samples : push_samples) {
+        all_push.insert(all_push.end(), samples.begin(), samples.end());
+    }
+    std::vector<uint64_t> all_pop;
+    all_pop.reserve(total);
+    for (const auto& samples : pop_samples) {
+        all_pop.insert(all_pop.end(), samples.begin(), samples.end());
+    }
+
+    const std::string label = layout + "_" + std::to_string(producer_count) + "p" + std::to_string(consumer_count) + "c";
+    std::cout << "mpmc " << layout << " indices, producers: " << producer_count << ", consumers: " << consumer_count
+              << ", " << static_cast<uint64_t>(total / elapsed) << " msgs/s\n";
+    export_latency_samples_csv(all_push, "../results/mpmc_push_" + label + ".csv", "mpmc producer (" + label + ")");
+    export_latency_samples_csv(all_pop, "../results/mpmc_pop_" + label + ".csv", "mpmc consumer (" + label + ")");
+}
+
+}  // namespace
+
+void run_mpmc_bench() {
+    for (int producers = 1; producers < kMaxThreads; ++producers) {
+        for (int consumers = 1; producers + consumers <= kMaxThreads; ++consumers) {
+            run_threads<IndexLayout::Shared>(producers, consumers, "shared");
+            run_threads<IndexLayout::Separate>(producers, consumers, "separate");
+        }
+    }
+}
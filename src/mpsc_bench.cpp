@@ -0,0 +1,111 @@
+#include "mpsc_bench.hpp"
+
+#include <atomic>
+#include <cstdint>
+#include <iostream>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+#include <x86intrin.h>
+
+#include "benchmark_utils.hpp"
+#include "mpsc_queue.hpp"
+
+namespace {
+
+// split across the producers, so every run moves the same amount of data
+constexpr std::size_t kTotalMessages = 2'000'000;
+constexpr int kMaxProducers = 10;
+
+struct OrderMsg {
+    uint64_t seq;
+    uint32_t producer;
+    uint32_t qty;
+};
+
+using Queue = MPSCQueue<OrderMsg, 1 << 16>;
+
+// one producer count: push cost per producer, pop cost on the consumer
+void run_producers(int producer_count) {
+    Queue queue;
+
+    const std::size_t per_producer = kTotalMessages / producer_count;
+    const std::size_t total = per_producer * producer_count;
+
+    std::vector<std::vector<uint64_t>> push_samples(producer_count);
+    std::atomic<int> ready{0};
+
+    std::vector<std::thread> producers;
+    producers.reserve(producer_count);
+    for (int p = 0; p < producer_count; ++p) {
+        producers.emplace_back([&, p] {
+            pin_thread_to_cpu(p + 2);
+            auto& samples = push_samples[p];
+            samples.resize(per_producer);
+
+            ready.fetch_add(1, std::memory_order_release);
+            while (ready.load(std::memory_order_acquire) != producer_count + 1) {
+            }
+
+            unsigned aux;
+            std::size_t i = 0;
+            while (i < per_producer) {
+                OrderMsg msg{i, static_cast<uint32_t>(p), static_cast<uint32_t>(i * 7)};
+                auto t0 = __rdtscp(&aux);
+                bool pushed = queue.try_push(msg);
+                if (pushed) {
+                    auto t1 = __rdtscp(&aux);
+                    samples[i++] = t1 - t0;
+                }
+            }
+        });
+    }
+
+    while (ready.load(std::memory_order_acquire) != producer_count) {
+    }
+    ready.fetch_add(1, std::memory_order_release);
+
+    // every producer's messages must arrive in its own order
+    std::vector<uint64_t> next_seq(producer_count, 0);
+    std::vector<uint64_t> pop_samples(total);
+
+    OrderMsg msg;
+    unsigned aux;
+    std::size_t i = 0;
+    while (i < total) {
+        auto t0 = __rdtscp(&aux);
+        bool popped = queue.try_pop(msg);
+        if (popped) {
+            auto t1 = __rdtscp(&aux);
+            pop_samples[i++] = t1 - t0;
+
+            if (msg.seq != next_seq[msg.producer]++) {
+                throw std::runtime_error("mpsc bench: producer " + std::to_string(msg.producer) + " reordered");
+            }
+        }
+    }
+
+    for (auto& producer : producers) {
+        producer.join();
+    }
+
+    std::vector<uint64_t> all_push;
+    all_push.reserve(total);
+    for (const auto& samples : push_samples) {
+        all_push.insert(all_push.end(), samples.begin(), samples.end());
+    }
+
+    const std::string label = std::to_string(producer_count) + "p";
+    std::cout << "mpsc producers: " << producer_count << '\n';
+    export_latency_samples_csv(all_push, "../results/mpsc_push_" + label + ".csv", "mpsc producer (" + label + ")");
+    export_latency_samples_csv(pop_samples, "../results/mpsc_pop_" + label + ".csv", "mpsc consumer (" + label + ")");
+}
+
+}  // namespace
+
+void run_mpsc_bench() {
+    for (int producers = 1; producers <= kMaxProducers; ++producers) {
+        run_producers(producers);
+    }
+}
@@ -0,0 +1,182 @@
+#include "perf_counters.hpp"
+#include <atomic>
+#include <cerrno>
+#include <cpuid.h>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <linux/perf_event.h>
+#include <stdexcept>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+namespace {
+
+[[noreturn]] void throw_errno(const std::string& what) {
+    throw std::runtime_error(what + " failed: " + std::strerror(errno));
+}
+
+bool is_intel() {
+    unsigned eax, ebx, ecx, edx;
+    if (!__get_cpuid(0, &eax, &ebx, &ecx, &edx)) {
+        return false;
+    }
+    char vendor[12];
+    std::memcpy(vendor, &ebx, 4);
+    std::memcpy(vendor + 4, &edx, 4);
+    std::memcpy(vendor + 8, &ecx, 4);
+    return std::memcmp(vendor, "GenuineIntel", 12) == 0;
+}
+
+uint64_t hw_cache_load_miss(uint64_t cache) {
+    return cache | (PERF_COUNT_HW_CACHE_OP_READ << 8) | (PERF_COUNT_HW_CACHE_RESULT_MISS << 16);
+}
+
+// this thread, any CPU, user space only so perf_event_paranoid 2 is enough
+int open_event(const PerfEvent& event, int group_fd) {
+    perf_event_attr attr{};
+    attr.size = sizeof(attr);
+    attr.type = event.type;
+    attr.config = event.config;
+    attr.disabled = group_fd == -1;
+    attr.exclude_kernel = 1;
+    attr.exclude_hv = 1;
+    attr.read_format = PERF_FORMAT_GROUP | PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+    return static_cast<int>(syscall(SYS_perf_event_open, &attr, 0, -1, group_fd, PERF_FLAG_FD_CLOEXEC));
+}
+
+}  // namespace
+
+std::vector<PerfEvent> default_perf_events() {
+    std::vector<PerfEvent> events{
+        {"cycles", PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES},
+        {"instructions", PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS},
+        {"l1d_load_misses", PERF_TYPE_HW_CACHE, hw_cache_load_miss(PERF_COUNT_HW_CACHE_L1D)},
+        {"llc_load_misses", PERF_TYPE_HW_CACHE, hw_cache_load_miss(PERF_COUNT_HW_CACHE_LL)},
+    };
+    if (is_intel()) {
+        // event 0xd2, umask 0x04
+        events.push_back({"snoop_hitm", PERF_TYPE_RAW, 0x04d2});
+    }
+    return events;
+}
+
+std::optional<PerfCounters> PerfCounters::open(const std::vector<PerfEvent>& events) {
+    std::vector<int> fds;
+    std::vector<std::string> names;
+    for (const PerfEvent& event : events) {
+        int fd = open_event(event, fds.empty() ? -1 : fds[0]);
+        if (fd >= 0) {
+            fds.push_back(fd);
+            names.push_back(event.name);
+            continue;
+        }
+
+        if (errno == EMFILE || errno == ENFILE) {
+            int err = errno;
+            for (int open_fd : fds) {
+                close(open_fd);
+            }
+            errno = err;
+            throw_errno("perf_event_open " + event.name);
+        }
+        if (fds.empty()) {
+            // every thread of a run tries, say it once
+            static std::atomic<bool> warned{false};
+            if (!warned.exchange(true)) {
+                std::cerr << "perf counters unavailable, perf_event_open " << event.name
+                          << ": " << std::strerror(errno) << '\n';
+            }
+            return std::nullopt;
+        }
+    }
+    return PerfCounters{std::move(fds), std::move(names)};
+}
+
+PerfCounters::PerfCounters(PerfCounters&& other) noexcept
+: fds_{std::move(other.fds_)}, names_{std::move(other.names_)}
+{
+    other.fds_.clear();
+}
+
+PerfCounters& PerfCounters::operator=(PerfCounters&& other) noexcept {
+    if (this != &other) {
+        close_all();
+        fds_ = std::move(other.fds_);
+        names_ = std::move(other.names_);
+        other.fds_.clear();
+    }
+    return *this;
+}
+
+PerfCounters::~PerfCounters() {
+    close_all();
+}
+
+void PerfCounters::close_all() {
+    for (int fd : fds_) {
+        close(fd);
+    }
+    fds_.clear();
+}
+
+void PerfCounters::start() {
+    if (ioctl(fds_[0], PERF_EVENT_IOC_RESET, PERF_IOC_FLAG_GROUP) != 0 ||
+        ioctl(fds_[0], PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP) != 0) {
+        throw_errno("starting perf counters");
+    }
+}
+
+void PerfCounters::stop() {
+    if (ioctl(fds_[0], PERF_EVENT_IOC_DISABLE, PERF_IOC_FLAG_GROUP) != 0) {
+        throw_errno("stopping perf counters");
+    }
+}
+
+std::vector<PerfCount> PerfCounters::read() const {
+    // nr, time enabled, time running, then one value per event in group order
+    std::vector<uint64_t> buffer(3 + fds_.size());
+    const ssize_t size = static_cast<ssize_t>(buffer.size() * sizeof(uint64_t));
+    if (::read(fds_[0], buffer.data(), buffer.size() * sizeof(uint64_t)) != size) {
+        throw_errno("reading perf counters");
+    }
+
+    const uint64_t enabled = buffer[1];
+    const uint64_t running = buffer[2];
+    std::vector<PerfCount> counts;
+    counts.reserve(fds_.size());
+    for (std::size_t i = 0; i < fds_.size(); ++i) {
+        uint64_t value = buffer[3 + i];
+        if (running != 0 && running < enabled) {
+            value = static_cast<uint64_t>(static_cast<double>(value) * static_cast<double>(enabled) / static_cast<double>(running));
+        }
+        counts.push_back({names_[i], value});
+    }
+    return counts;
+}
+
+void report_perf_counts(const std::vector<ThreadPerfCounts>& threads, const std::string& file_name) {
+    if (threads.empty()) {
+        return;
+    }
+
+    std::ofstream out(file_name);
+    if (!out) {
+        throw std::runtime_error("can't open " + file_name);
+    }
+    out << "thread,event,count,per_message\n";
+
+    std::cout << "perf counters (total, per message)\n";
+    for (const ThreadPerfCounts& thread : threads) {
+        std::cout << thread.thread << ':';
+        for (const PerfCount& count : thread.counts) {
+            const double per_message = thread.messages
+                ? static_cast<double>(count.value) / static_cast<double>(thread.messages)
+                : 0.0;
+            out << thread.thread << ',' << count.name << ',' << count.value << ',' << per_message << '\n';
+            std::cout << ' ' << count.name << ' ' << count.value << " (" << per_message << ')';
+        }
+        std::cout << '\n';
+    }
+}
@@ -0,0 +1,175 @@
+#include "shared_segment.hpp"
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <stdexcept>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/vfs.h>
+#include <unistd.h>
+#include <utility>
+
+namespace {
+
+constexpr const char* hugetlbfsMount = "/dev/hugepages";
+
+[[noreturn]] void throw_errno(const std::string& what) {
+    throw std::runtime_error(what + " failed: " + std::strerror(errno));
+}
+
+std::string shm_name(const std::string& name) {
+    return "/" + name;
+}
+
+std::string hugetlbfs_path(const std::string& name) {
+    return std::string(hugetlbfsMount) + "/" + name;
+}
+
+// page size of the hugetlbfs mount, 0 if it is not mounted
+size_t huge_page_size() {
+    struct statfs fs;
+    if (statfs(hugetlbfsMount, &fs) != 0 || fs.f_type != 0x958458f6 /* HUGETLBFS_MAGIC */) {
+        return 0;
+    }
+    return static_cast<size_t>(fs.f_bsize);
+}
+
+size_t round_up(size_t size, size_t page) {
+    return (size + page - 1) / page * page;
+}
+
+std::byte* map_fd(int fd, size_t size) {
+    void* data = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    return data == MAP_FAILED ? nullptr : static_cast<std::byte*>(data);
+}
+
+}  // namespace
+
+std::optional<SharedSegment> SharedSegment::create(const std::string& name, size_t size, ShmBacking backing) {
+    if (backing != ShmBacking::Pages4K) {
+        const size_t hugePage = huge_page_size();
+        if (hugePage == 0 && backing == ShmBacking::HugePages) {
+            throw std::runtime_error(std::string("no hugetlbfs mounted at ") + hugetlbfsMount);
+        }
+
+        if (hugePage != 0) {
+            const std::string path = hugetlbfs_path(name);
+            int fd = open(path.c_str(), O_RDWR | O_CREAT | O_EXCL | O_CLOEXEC, 0600);
+            if (fd < 0 && errno == EEXIST) {
+                return std::nullopt;
+            }
+            if (fd < 0) {
+                throw_errno("open " + path);
+            }
+
+            const size_t mappedSize = round_up(size, hugePage);
+            std::byte* data = ftruncate(fd, static_cast<off_t>(mappedSize)) == 0 ? map_fd(fd, mappedSize) : nullptr;
+            int err = errno;
+            close(fd);
+
+            if (data) {
+                return SharedSegment{data, mappedSize, true};
+            }
+
+            // most likely no free huge pages, don't leave a half created file behind
+            ::unlink(path.c_str());
+            if (backing == ShmBacking::HugePages) {
+                errno = err;
+                throw_errno("mapping huge pages for " + path);
+            }
+        }
+    }
+
+    // an Auto channel that fell back must not collide with a hugetlbfs one of the same name
+    if (access(hugetlbfs_path(name).c_str(), F_OK) == 0) {
+        return std::nullopt;
+    }
+
+    int fd = shm_open(shm_name(name).c_str(), O_RDWR | O_CREAT | O_EXCL, 0600);
+    if (fd < 0 && errno == EEXIST) {
+        return std::nullopt;
+    }
+    if (fd < 0) {
+        throw_errno("shm_open " + name);
+    }
+
+    const size_t mappedSize = round_up(size, static_cast<size_t>(sysconf(_SC_PAGESIZE)));
+    std::byte* data = ftruncate(fd, static_cast<off_t>(mappedSize)) == 0 ? map_fd(fd, mappedSize) : nullptr;
+    int err = errno;
+    close(fd);
+
+    if (!data) {
+        shm_unlink(shm_name(name).c_str());
+        errno = err;
+        throw_errno("sizing and mapping " + name);
+    }
+
+    return SharedSegment{data, mappedSize, false};
+}
+
+std::optional<SharedSegment> SharedSegment::open_existing(const std::string& name) {
+    bool hugePages = true;
+    int fd = open(hugetlbfs_path(name).c_str(), O_RDWR | O_CLOEXEC);
+    if (fd < 0) {
+        hugePages = false;
+        fd = shm_open(shm_name(name).c_str(), O_RDWR, 0);
+    }
+    if (fd < 0 && errno == ENOENT) {
+        return std::nullopt;
+    }
+    if (fd < 0) {
+        throw_errno("opening " + name);
+    }
+
+    struct stat st;
+    if (fstat(fd, &st) != 0) {
+        int err = errno;
+        close(fd);
+        errno = err;
+        throw_errno("fstat " + name);
+    }
+
+    const size_t size = static_cast<size_t>(st.st_size);
+    std::byte* data = size == 0 ? nullptr : map_fd(fd, size);
+    int err = errno;
+    close(fd);
+
+    if (size == 0) {
+        return std::nullopt;
+    }
+    if (!data) {
+        errno = err;
+        throw_errno("mmap " + name);
+    }
+
+    return SharedSegment{data, size, hugePages};
+}
+
+void SharedSegment::unlink(const std::string& name) {
+    ::unlink(hugetlbfs_path(name).c_str());
+    shm_unlink(shm_name(name).c_str());
+}
+
+SharedSegment::SharedSegment(SharedSegment&& other) noexcept
+: data_{std::exchange(other.data_, nullptr)},
+  size_{std::exchange(other.size_, 0)},
+  hugePages_{other.hugePages_}
+{}
+
+SharedSegment& SharedSegment::operator=(SharedSegment&& other) noexcept {
+    if (this != &other) {
+        if (data_) {
+            munmap(data_, size_);
+        }
+        data_ = std::exchange(other.data_, nullptr);
+        size_ = std::exchange(other.size_, 0);
+        hugePages_ = other.hugePages_;
+    }
+    return *this;
+}
+
+SharedSegment::~SharedSegment() {
+    if (data_) {
+        munmap(data_, size_);
+    }
+}
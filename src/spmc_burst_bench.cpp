@@ -1,64 +1,34 @@
 #include "spmc_burst_bench.hpp"
 
 #include <algorithm>
+#include <array>
 #include <barrier>
+#include <bit>
 #include <cstdint>
 #include <fstream>
 #include <iostream>
 #include <numeric>
-#include <random>
+#include <span>
 #include <string>
 #include <thread>
 #include <vector>
 #include <x86intrin.h>
 
+#include "bench_messages.hpp"
 #include "benchmark_utils.hpp"
+#include "perf_counters.hpp"
 #include "spmc_queue_trivially_copiable.hpp"
 
 namespace {
 
 constexpr std::size_t kTotalMessages = 2'000'000;
 constexpr std::size_t kBurstSize = 655'360;
-
-enum class Side : char {
-    None = 0,
-    Bid = 'B',
-    Ask = 'S'
-};
-
-struct BestLvlChange {
-    uint64_t qty;
-    uint32_t price;
-    Side side;
-};
-
-std::vector<BestLvlChange> make_random_changes(
-    std::size_t n,
-    uint32_t min_price,
-    uint32_t max_price,
-    uint64_t min_qty,
-    uint64_t max_qty,
-    uint64_t seed = 123456789
-) {
-    std::mt19937_64 rng(seed);
-
-    std::uniform_int_distribution<uint32_t> price_dist(min_price, max_price);
-    std::uniform_int_distribution<uint64_t> qty_dist(min_qty, max_qty);
-    std::uniform_int_distribution<int> side_dist(0, 1);
-
-    std::vector<BestLvlChange> values;
-    values.reserve(n);
-
-    for (std::size_t i = 0; i < n; ++i) {
-        BestLvlChange change;
-        change.price = price_dist(rng);
-        change.qty = qty_dist(rng);
-        change.side = side_dist(rng) == 0 ? Side::Bid : Side::Ask;
-        values.push_back(change);
-    }
-
-    return values;
-}
+// holds a whole kBurstSize epoch, so however the consumers are scheduled
+// within an epoch the producer can't lap them
+constexpr uint64_t kBurstRingSlots = kBurstSize;
+constexpr std::size_t kSweepBurstSize = 4'096;
+// messages per push_bulk/pop_bulk call, about one decoded packet
+constexpr std::size_t kBulkSize = 32;
 
 struct EpochMetrics {
     std::size_t messages;
@@ -92,24 +62,41 @@ void export_epoch_metrics_csv(
     }
 }
 
-}  // namespace
-
-void run_spmc_burst_bench(int consumer_count) {
+template<uint64_t Capacity, VersionLayout Versions = VersionLayout::InSlot>
+void run_burst(
+    int consumer_count,
+    std::size_t burst_size,
+    bool bulk,
+    const std::string& csv_name,
+    const RingAllocOptions& alloc = {},
+    bool perf_counters = false
+) {
     if (consumer_count <= 0) {
         throw std::invalid_argument("consumer_count must be positive");
     }
 
-    SPMCQueue<BestLvlChange> queue;
+    // a burst larger than the ring would lap the consumers
+    if (burst_size > std::bit_ceil(Capacity)) {
+        throw std::invalid_argument("burst_size must not exceed the ring size");
+    }
+
+    using Queue = SPMCQueue<
+        BestLvlChange, Capacity, SpinWait, OverrunPolicy::Abort, default_seqlock_read, Versions
+    >;
+    Queue queue{alloc};
     auto changes = make_random_changes(kTotalMessages, 1000, 100'000, 10, 100'000);
 
-    const std::size_t epoch_count = (kTotalMessages + kBurstSize - 1) / kBurstSize;
+    const std::size_t epoch_count = (kTotalMessages + burst_size - 1) / burst_size;
     std::vector<EpochMetrics> metrics(epoch_count);
     std::vector<uint64_t> consumer_done_cycles(consumer_count, 0);
 
+    // [0] is the producer, [1 + i] consumer i
+    std::vector<ThreadPerfCounts> perf(consumer_count + 1);
+
     std::barrier epoch_start{consumer_count + 1};
     std::barrier epoch_end{consumer_count + 1};
 
-    std::vector<SPMCQueue<BestLvlChange>::Consumer> consumers;
+    std::vector<typename Queue::Consumer> consumers;
     consumers.reserve(consumer_count);
     for (int i = 0; i < consumer_count; ++i) {
         consumers.push_back(queue.make_consumer());
@@ -123,16 +110,36 @@ void run_spmc_burst_bench(int consumer_count) {
             pin_thread_to_cpu(consumer_index + 2);
 
             BestLvlChange value;
+            std::array<BestLvlChange, kBulkSize> batch;
+
+            auto counters = perf_counters ? PerfCounters::open() : std::nullopt;
+            if (counters) {
+                counters->start();
+            }
 
             for (std::size_t epoch = 0; epoch < epoch_count; ++epoch) {
-                const std::size_t start = epoch * kBurstSize;
-                const std::size_t count = std::min(kBurstSize, kTotalMessages - start);
+                const std::size_t start = epoch * burst_size;
+                const std::size_t count = std::min(burst_size, kTotalMessages - start);
 
                 epoch_start.arrive_and_wait();
 
-                for (std::size_t i = 0; i < count; ++i) {
-                    while (!consumers[consumer_index].pop(value)) {
-                        _mm_pause();
+                if (bulk) {
+                    std::size_t received = 0;
+                    while (received < count) {
+                        const std::size_t want = std::min(kBulkSize, count - received);
+                        const std::size_t got = consumers[consumer_index].pop_bulk(
+                            std::span<BestLvlChange>(batch.data(), want)
+                        );
+                        if (got == 0) {
+                            _mm_pause();
+                        }
+                        received += got;
+                    }
+                } else {
+                    for (std::size_t i = 0; i < count; ++i) {
+                        while (!consumers[consumer_index].pop(value)) {
+                            _mm_pause();
+                        }
                     }
                 }
 
@@ -140,21 +147,39 @@ void run_spmc_burst_bench(int consumer_count) {
                 consumer_done_cycles[consumer_index] = __rdtscp(&aux);
                 epoch_end.arrive_and_wait();
             }
+
+            if (counters) {
+                counters->stop();
+                perf[1 + consumer_index] = {"consumer_" + std::to_string(consumer_index), kTotalMessages, counters->read()};
+            }
         });
     }
 
     pin_thread_to_cpu(1);
 
+    auto counters = perf_counters ? PerfCounters::open() : std::nullopt;
+    if (counters) {
+        counters->start();
+    }
+
     unsigned aux;
     for (std::size_t epoch = 0; epoch < epoch_count; ++epoch) {
-        const std::size_t start = epoch * kBurstSize;
-        const std::size_t count = std::min(kBurstSize, kTotalMessages - start);
+        const std::size_t start = epoch * burst_size;
+        const std::size_t count = std::min(burst_size, kTotalMessages - start);
 
         epoch_start.arrive_and_wait();
 
         const uint64_t producer_start = __rdtscp(&aux);
-        for (std::size_t i = 0; i < count; ++i) {
-            queue.push(changes[start + i]);
+        if (bulk) {
+            for (std::size_t i = 0; i < count; i += kBulkSize) {
+                queue.push_bulk(std::span<const BestLvlChange>(changes).subspan(
+                    start + i, std::min(kBulkSize, count - i)
+                ));
+            }
+        } else {
+            for (std::size_t i = 0; i < count; ++i) {
+                queue.push(changes[start + i]);
+            }
         }
         epoch_end.arrive_and_wait();
 
@@ -167,11 +192,16 @@ void run_spmc_burst_bench(int consumer_count) {
         };
     }
 
+    if (counters) {
+        counters->stop();
+        perf[0] = {"producer", kTotalMessages, counters->read()};
+    }
+
     for (auto& thread : threads) {
         thread.join();
     }
 
-    export_epoch_metrics_csv(metrics, "../results/spmc_burst_epochs.csv");
+    export_epoch_metrics_csv(metrics, csv_name);
 
     const uint64_t total_processing_cycles = std::accumulate(
         metrics.begin(), metrics.end(), uint64_t{0},
@@ -183,13 +213,97 @@ void run_spmc_burst_bench(int consumer_count) {
 
     std::cout << "spmc_burst_bench\n";
     std::cout << "consumers: " << consumer_count << '\n';
-    std::cout << "messages per epoch: " << kBurstSize << '\n';
+    std::cout << "path: " << (bulk ? "push_bulk/pop_bulk" : "push/pop") << '\n';
+    std::cout << "ring slots: " << std::bit_ceil(Capacity) << '\n';
+    std::cout << "ring memory: " << ring_pages_name(queue.ring_pages()) << '\n';
+    std::cout << "versions: " << (Versions == VersionLayout::InSlot ? "in slot" : "separate array") << '\n';
+    std::cout << "messages per epoch: " << burst_size << '\n';
     std::cout << "epochs: " << epoch_count << '\n';
     std::cout << "processing throughput (ops/s): "
               << (static_cast<double>(kTotalMessages) * static_cast<double>(tsc_freq) /
                   static_cast<double>(total_processing_cycles))
               << '\n';
+    std::cout << "processing time per message (ns): "
+              << (static_cast<double>(cycles_to_ns(total_processing_cycles, tsc_freq)) /
+                  static_cast<double>(kTotalMessages))
+              << '\n';
+    // the first pass through the ring takes the page faults and cold TLB entries
+    const uint64_t later_cycles = total_processing_cycles - metrics[0].processing_cycles;
+    const std::size_t later_messages = kTotalMessages - metrics[0].messages;
+    std::cout << "first epoch time per message (ns): "
+              << (static_cast<double>(cycles_to_ns(metrics[0].processing_cycles, tsc_freq)) /
+                  static_cast<double>(metrics[0].messages))
+              << '\n';
+    if (later_messages > 0) {
+        std::cout << "later epochs time per message (ns): "
+                  << (static_cast<double>(cycles_to_ns(later_cycles, tsc_freq)) /
+                      static_cast<double>(later_messages))
+                  << '\n';
+    }
     std::cout << "processing time per burst (cycles, summed): "
               << total_processing_cycles
               << '\n';
+
+    std::erase_if(perf, [](const ThreadPerfCounts& thread) { return thread.counts.empty(); });
+    report_perf_counts(perf, csv_name.substr(0, csv_name.rfind(".csv")) + "_perf.csv");
+}
+
+}  // namespace
+
+void run_spmc_burst_bench(int consumer_count) {
+    run_burst<kBurstRingSlots>(
+        consumer_count, kBurstSize, false, "../results/spmc_burst_epochs.csv"
+    );
+}
+
+void run_spmc_burst_bench_bulk(int consumer_count) {
+    run_burst<kBurstRingSlots>(
+        consumer_count, kBurstSize, true, "../results/spmc_burst_epochs_bulk.csv"
+    );
+}
+
+void run_spmc_ring_size_sweep(int consumer_count) {
+    // same burst for every ring, so only the memory footprint changes:
+    // small rings stay cache resident, large ones walk cold lines and pages
+    run_burst<(1u << 12)>(consumer_count, kSweepBurstSize, false, "../results/spmc_burst_epochs_4096.csv");
+    run_burst<(1u << 14)>(consumer_count, kSweepBurstSize, false, "../results/spmc_burst_epochs_16384.csv");
+    run_burst<(1u << 16)>(consumer_count, kSweepBurstSize, false, "../results/spmc_burst_epochs_65536.csv");
+    run_burst<(1u << 18)>(consumer_count, kSweepBurstSize, false, "../results/spmc_burst_epochs_262144.csv");
+    run_burst<(1u << 20)>(consumer_count, kSweepBurstSize, false, "../results/spmc_burst_epochs_1048576.csv");
+}
+
+void run_spmc_version_layout_bench(int consumer_count) {
+    // consumers poll only the version array in the separate layout, compare
+    // their L1D misses and HITMs per message between the two runs
+    run_burst<kBurstRingSlots, VersionLayout::InSlot>(
+        consumer_count, kBurstSize, false, "../results/spmc_burst_epochs_inslot_versions.csv", {}, true
+    );
+    run_burst<kBurstRingSlots, VersionLayout::Separate>(
+        consumer_count, kBurstSize, false, "../results/spmc_burst_epochs_separate_versions.csv", {}, true
+    );
+}
+
+void run_spmc_alloc_bench(int consumer_count) {
+    // bind to the node of the first consumer, the producer is expected nearby
+    const int node = numa_node_of_cpu(2);
+
+    // each run prints the pages it asked for, run_burst the ones it got
+    std::cout << "requested: default\n";
+    run_burst<kBurstRingSlots>(
+        consumer_count, kBurstSize, false, "../results/spmc_burst_epochs_alloc_default.csv"
+    );
+
+    std::cout << "requested: transparent huge pages, node " << node << ", prefaulted\n";
+    run_burst<kBurstRingSlots>(
+        consumer_count, kBurstSize, false, "../results/spmc_burst_epochs_alloc_thp.csv",
+        RingAllocOptions{.pages = RingPages::TransparentHuge, .numaNode = node, .prefault = true}
+    );
+
+    // the 64 MiB ring needs 32 reserved hugetlb pages (vm.nr_hugepages) and
+    // ulimit -l of at least 64 MiB, without the pages it falls back to THP
+    std::cout << "requested: hugetlb pages, node " << node << ", prefaulted, locked\n";
+    run_burst<kBurstRingSlots>(
+        consumer_count, kBurstSize, false, "../results/spmc_burst_epochs_alloc_hugetlb.csv",
+        RingAllocOptions{.pages = RingPages::Huge, .numaNode = node, .prefault = true, .lock = true}
+    );
 }
@@ -1,7 +1,33 @@
 #include "spsc_buffer.hpp"
+#include "mirrored_mapping.hpp"
 #include <atomic>
 #include <cstring>
 #include <algorithm>
+#include <bit>
+#include <stdexcept>
+
+namespace {
+
+size_t ring_size(size_t capacity, RingMapping mapping) {
+    // a mirrored ring is made of whole pages, the page size is a power of two
+    size_t minimum = mapping == RingMapping::Mirrored ? MirroredMapping::page_size() : 2;
+    return std::bit_ceil(std::max(capacity, minimum));
+}
+
+}  // namespace
+
+SPSCBuffer::SPSCBuffer(size_t capacity, RingMapping mapping, const RingAllocOptions& options)
+: bufferSize_{ring_size(capacity, mapping)},
+  mirrored_{mapping == RingMapping::Mirrored},
+  memory_{mirrored_ ? nullptr : std::make_unique<RingMemory>(bufferSize_, options)},
+  mirror_{mirrored_ ? std::make_unique<MirroredMapping>(bufferSize_) : nullptr},
+  buffer_{mirrored_ ? mirror_->data() : memory_->data()}
+{
+    if (mirrored_) {
+        // both halves share the pages, preparing the first one covers the ring
+        prepare_ring_memory(buffer_, bufferSize_, options);
+    }
+}
 
 size_t SPSCBuffer::available(size_t writer, size_t reader) const {
     if (reader > writer) {
@@ -23,11 +49,11 @@ size_t SPSCBuffer::read(std::span<std::byte> dst) {
     size_t n = std::min({ avail, dst.size_bytes() });
     size_t spaceToEnd = bufferSize_ - reader;
 
-    if (n <= spaceToEnd) {
-        std::memcpy(dst.data(), buffer_.get() + reader, n);
+    if (mirrored_ || n <= spaceToEnd) {
+        std::memcpy(dst.data(), buffer_ + reader, n);
         size_t newReader = reader + n;
-        if (newReader == bufferSize_) {
-            newReader = 0;
+        if (newReader >= bufferSize_) {
+            newReader -= bufferSize_;
         }
 
         reader_.store(newReader, std::memory_order_release);
@@ -35,8 +61,8 @@ size_t SPSCBuffer::read(std::span<std::byte> dst) {
         size_t firstLen = spaceToEnd;
         size_t secondLen = n - firstLen;
 
-        std::memcpy(dst.data(), buffer_.get() + reader, firstLen);
-        std::memcpy(dst.data() + firstLen, buffer_.get(), secondLen);
+        std::memcpy(dst.data(), buffer_ + reader, firstLen);
+        std::memcpy(dst.data() + firstLen, buffer_, secondLen);
 
         reader_.store(secondLen, std::memory_order_release);
     }
@@ -53,16 +79,19 @@ bool SPSCBuffer::try_write(std::span<const std::byte> data) {
         return false;
     }
 
-    if (writer + data.size_bytes() < bufferSize_) {
-        std::memcpy(buffer_.get() + writer, data.data(), data.size_bytes());
+    if (mirrored_ || writer + data.size_bytes() < bufferSize_) {
+        std::memcpy(buffer_ + writer, data.data(), data.size_bytes());
 
         size_t newWriter = writer + data.size_bytes();
+        if (newWriter >= bufferSize_) {
+            newWriter -= bufferSize_;
+        }
         writer_.store(newWriter, std::memory_order_release);
     } else {
         size_t firstPart = bufferSize_ - writer;
 
-        std::memcpy(buffer_.get() + writer, data.data(), bufferSize_ - writer);
-        std::memcpy(buffer_.get(), data.data() + firstPart, data.size_bytes() - firstPart);
+        std::memcpy(buffer_ + writer, data.data(), bufferSize_ - writer);
+        std::memcpy(buffer_, data.data() + firstPart, data.size_bytes() - firstPart);
 
         size_t newWriter = data.size_bytes() - firstPart;
         writer_.store(newWriter, std::memory_order_release);
@@ -70,3 +99,141 @@ bool SPSCBuffer::try_write(std::span<const std::byte> data) {
 
     return true;
 }
+
+ReadView SPSCBuffer::peek() const {
+    size_t reader = reader_.load(std::memory_order_relaxed);
+    size_t writer = writer_.load(std::memory_order_acquire);
+
+    size_t avail = available(writer, reader);
+    size_t firstLen = mirrored_ ? avail : std::min(avail, bufferSize_ - reader);
+
+    return ReadView{
+        .first = {buffer_ + reader, firstLen},
+        .second = {buffer_, avail - firstLen},
+    };
+}
+
+void SPSCBuffer::consume(size_t n) {
+    size_t newReader = reader_.load(std::memory_order_relaxed) + n;
+    if (newReader >= bufferSize_) {
+        newReader -= bufferSize_;
+    }
+
+    reader_.store(newReader, std::memory_order_release);
+}
+
+WriteView SPSCBuffer::reserve(size_t n) {
+    size_t writer = writer_.load(std::memory_order_relaxed);
+    size_t reader = reader_.load(std::memory_order_acquire);
+
+    size_t freeSpace = bufferSize_ - 1 - available(writer, reader);
+    if (freeSpace < n) {
+        return {};
+    }
+
+    size_t firstLen = mirrored_ ? n : std::min(n, bufferSize_ - writer);
+
+    return WriteView{
+        .first = {buffer_ + writer, firstLen},
+        .second = {buffer_, n - firstLen},
+    };
+}
+
+void SPSCBuffer::commit(size_t n) {
+    size_t newWriter = writer_.load(std::memory_order_relaxed) + n;
+    if (newWriter >= bufferSize_) {
+        newWriter -= bufferSize_;
+    }
+
+    writer_.store(newWriter, std::memory_order_release);
+}
+
+bool SPSCBuffer::try_write_msg(std::span<const std::byte> msg) {
+    if (msg.empty() || msg.size_bytes() > max_msg_size()) {
+        throw std::invalid_argument("message size must be in [1, max_msg_size()]");
+    }
+
+    size_t writer = writer_.load(std::memory_order_relaxed);
+    size_t reader = reader_.load(std::memory_order_acquire);
+
+    size_t recordSize = record_size(msg.size_bytes());
+    size_t spaceToEnd = bufferSize_ - writer;
+    // the pad marker burns the rest of the ring, the mirror makes it unnecessary
+    bool pad = !mirrored_ && recordSize > spaceToEnd;
+    size_t needed = pad ? spaceToEnd + recordSize : recordSize;
+
+    size_t freeSpace = bufferSize_ - 1 - available(writer, reader);
+    if (freeSpace < needed) {
+        return false;
+    }
+
+    if (pad) {
+        std::memcpy(buffer_ + writer, &padMarker_, sizeof(MsgHeader));
+        writer = 0;
+    }
+
+    MsgHeader header = static_cast<MsgHeader>(msg.size_bytes());
+    std::memcpy(buffer_ + writer, &header, sizeof(MsgHeader));
+    std::memcpy(buffer_ + writer + sizeof(MsgHeader), msg.data(), msg.size_bytes());
+
+    size_t newWriter = writer + recordSize;
+    if (newWriter >= bufferSize_) {
+        newWriter -= bufferSize_;
+    }
+
+    writer_.store(newWriter, std::memory_order_release);
+    return true;
+}
+
+std::span<const std::byte> SPSCBuffer::peek_msg() {
+    size_t reader = reader_.load(std::memory_order_relaxed);
+    size_t writer = writer_.load(std::memory_order_acquire);
+
+    if (reader == writer) {
+        return {};
+    }
+
+    MsgHeader header;
+    std::memcpy(&header, buffer_ + reader, sizeof(MsgHeader));
+
+    if (header == padMarker_) {
+        // the producer wrapped, the record is at offset 0. Give the tail back right away
+        reader = 0;
+        reader_.store(reader, std::memory_order_release);
+        if (reader == writer) {
+            return {};
+        }
+        std::memcpy(&header, buffer_, sizeof(MsgHeader));
+    }
+
+    return {buffer_ + reader + sizeof(MsgHeader), header};
+}
+
+void SPSCBuffer::consume_msg() {
+    size_t reader = reader_.load(std::memory_order_relaxed);
+
+    MsgHeader header;
+    std::memcpy(&header, buffer_ + reader, sizeof(MsgHeader));
+
+    size_t newReader = reader + record_size(header);
+    if (newReader >= bufferSize_) {
+        newReader -= bufferSize_;
+    }
+
+    reader_.store(newReader, std::memory_order_release);
+}
+
+size_t SPSCBuffer::read_msg(std::span<std::byte> dst) {
+    std::span<const std::byte> msg = peek_msg();
+    if (msg.empty()) {
+        return 0;
+    }
+
+    if (msg.size_bytes() > dst.size_bytes()) {
+        throw std::length_error("destination is smaller than the next message");
+    }
+
+    std::memcpy(dst.data(), msg.data(), msg.size_bytes());
+    consume_msg();
+    return msg.size_bytes();
+}
@@ -23,11 +23,11 @@ size_t IPCSPSCBuffer::read(std::span<std::byte> dst) {
     size_t n = std::min(avail, dst.size_bytes());
     size_t spaceToEnd = bufferSize_ - reader;
 
-    if (n <= spaceToEnd) {
+    if (mirrored_ || n <= spaceToEnd) {
         std::memcpy(dst.data(), buffer_ + reader, n);
         size_t newReader = reader + n;
-        if (newReader == bufferSize_) {
-            newReader = 0;
+        if (newReader >= bufferSize_) {
+            newReader -= bufferSize_;
         }
 
         reader_.store(newReader, std::memory_order_release);
@@ -53,10 +53,13 @@ bool IPCSPSCBuffer::try_write(std::span<const std::byte> data) {
         return false;
     }
 
-    if (writer + data.size_bytes() < bufferSize_) {
+    if (mirrored_ || writer + data.size_bytes() < bufferSize_) {
         std::memcpy(buffer_ + writer, data.data(), data.size_bytes());
 
         size_t newWriter = writer + data.size_bytes();
+        if (newWriter >= bufferSize_) {
+            newWriter -= bufferSize_;
+        }
         writer_.store(newWriter, std::memory_order_release);
     } else {
         size_t firstPart = bufferSize_ - writer;
@@ -70,3 +73,51 @@ bool IPCSPSCBuffer::try_write(std::span<const std::byte> data) {
 
     return true;
 }
+
+ReadView IPCSPSCBuffer::peek() const {
+    size_t reader = reader_.load(std::memory_order_relaxed);
+    size_t writer = writer_.load(std::memory_order_acquire);
+
+    size_t avail = available(writer, reader);
+    size_t firstLen = mirrored_ ? avail : std::min(avail, bufferSize_ - reader);
+
+    return ReadView{
+        .first = {buffer_ + reader, firstLen},
+        .second = {buffer_, avail - firstLen},
+    };
+}
+
+void IPCSPSCBuffer::consume(size_t n) {
+    size_t newReader = reader_.load(std::memory_order_relaxed) + n;
+    if (newReader >= bufferSize_) {
+        newReader -= bufferSize_;
+    }
+
+    reader_.store(newReader, std::memory_order_release);
+}
+
+WriteView IPCSPSCBuffer::reserve(size_t n) {
+    size_t writer = writer_.load(std::memory_order_relaxed);
+    size_t reader = reader_.load(std::memory_order_acquire);
+
+    size_t freeSpace = bufferSize_ - 1 - available(writer, reader);
+    if (freeSpace < n) {
+        return {};
+    }
+
+    size_t firstLen = mirrored_ ? n : std::min(n, bufferSize_ - writer);
+
+    return WriteView{
+        .first = {buffer_ + writer, firstLen},
+        .second = {buffer_, n - firstLen},
+    };
+}
+
+void IPCSPSCBuffer::commit(size_t n) {
+    size_t newWriter = writer_.load(std::memory_order_relaxed) + n;
+    if (newWriter >= bufferSize_) {
+        newWriter -= bufferSize_;
+    }
+
+    writer_.store(newWriter, std::memory_order_release);
+}
@@ -0,0 +1,91 @@
+#include "wait_bench.hpp"
+
+#include <atomic>
+#include <cstdint>
+#include <ctime>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+#include <x86intrin.h>
+
+#include "benchmark_utils.hpp"
+#include "spsc_queue.hpp"
+#include "wait_policy.hpp"
+
+namespace {
+
+constexpr std::size_t kMessages = 20'000;
+// low-rate control channel: the consumer is idle between messages
+constexpr long kGapNs = 50'000;
+
+struct WakeMsg {
+    uint64_t sent_tsc;
+    uint64_t seq;
+};
+
+uint64_t thread_cpu_ns() {
+    timespec ts;
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+    return ts.tv_sec * 1'000'000'000ull + ts.tv_nsec;
+}
+
+uint64_t wall_ns() {
+    timespec ts;
+    clock_gettime(CLOCK_MONOTONIC_RAW, &ts);
+    return ts.tv_sec * 1'000'000'000ull + ts.tv_nsec;
+}
+
+template<typename Wait>
+void run_policy(const std::string& name) {
+    SPSCQueue<WakeMsg, 1024, SlotLayout::CacheLine, Wait> queue;
+
+    std::vector<uint64_t> samples(kMessages);
+    double consumer_cpu = 0.0;
+
+    std::thread consumer([&] {
+        pin_thread_to_cpu(2);
+
+        const uint64_t cpu0 = thread_cpu_ns();
+        const uint64_t wall0 = wall_ns();
+
+        WakeMsg msg;
+        unsigned aux;
+        for (std::size_t i = 0; i < kMessages; ++i) {
+            queue.wait_pop(msg);
+            samples[i] = __rdtscp(&aux) - msg.sent_tsc;
+        }
+
+        consumer_cpu = static_cast<double>(thread_cpu_ns() - cpu0) /
+                       static_cast<double>(wall_ns() - wall0);
+    });
+
+    timespec gap{0, kGapNs};
+    unsigned aux;
+    for (std::size_t i = 0; i < kMessages; ++i) {
+        nanosleep(&gap, nullptr);
+        WakeMsg msg{__rdtscp(&aux), i};
+        while (!queue.try_push(msg)) {
+        }
+    }
+
+    consumer.join();
+
+    export_latency_samples_csv(samples, "../results/wake_latency_" + name + ".csv", "wait policy: " + name);
+    std::cout << "consumer cpu use (%): " << consumer_cpu * 100.0 << '\n';
+}
+
+}  // namespace
+
+void run_wait_policy_bench() {
+    pin_thread_to_cpu(1);
+
+    run_policy<SpinWait>("spin");
+    run_policy<PauseBackoffWait>("pause");
+    if (!UmwaitWait::supported()) {
+        std::cout << "umwait: WAITPKG not supported, falls back to pause backoff\n";
+    }
+    run_policy<UmwaitWait>("umwait");
+    run_policy<FutexWait<>>("futex");
+    run_policy<HybridWait>("hybrid");
+}